@@ -6,13 +6,15 @@
 #include <cstdlib>
 #include <exception>
 #include <iostream>
+#include <stdexcept>
 
 struct KeyError {};
 
 /**
- * A special kind of node for an AVL tree, which adds the balance as a data member, plus
- * other additional helper functions. You do NOT need to implement any functionality or
- * add additional data members or helper functions.
+ * A special kind of node for an AVL tree, which adds the balance, plus
+ * other additional helper functions. The balance (bits 0-7) and the
+ * tombstone flag (bit 8) live in the tag bits of the links (see Node),
+ * so an AVLNode is no larger than a plain Node.
  */
 template<typename Key, typename Value>
 class AVLNode : public Node<Key, Value> {
@@ -26,6 +28,12 @@ public:
     void setBalance(char balance);
     void updateBalance(char diff);
 
+#ifdef AVL_STORE_HEIGHT
+    // Exact height of the subtree rooted here (a leaf is 1).
+    int getHeight() const;
+    void setHeight(int height);
+#endif
+
     // Getters for parent, left, and right. These need to be redefined since they
     // return pointers to AVLNodes - not plain Nodes. See the Node class in bst.h
     // for more information.
@@ -33,8 +41,19 @@ public:
     virtual AVLNode<Key, Value>* getLeft() const override;
     virtual AVLNode<Key, Value>* getRight() const override;
 
+    // Lazy deletion: a tombstoned node stays linked but is skipped by
+    // find() and iteration until the tree is compacted.
+    virtual bool isTombstone() const override;
+    void setTombstone(bool tombstone);
+    virtual AVLNode<Key, Value>* clone() const override;
+
 protected:
-    signed char balance_;
+    static const unsigned TOMBSTONE = 0x100;
+#ifdef AVL_STORE_HEIGHT
+    // AVL(k) trees grow taller as k grows: with 2^64 nodes the worst
+    // case is 92 levels for k = 1 but about 1260 for k = 100, past a byte
+    unsigned short height_;
+#endif
 };
 
 /*
@@ -49,7 +68,11 @@ protected:
  */
 template<class Key, class Value>
 AVLNode<Key, Value>::AVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent)
-        : Node<Key, Value>(key, value, parent), balance_(0) {}
+        : Node<Key, Value>(key, value, parent)
+#ifdef AVL_STORE_HEIGHT
+        , height_(1)
+#endif
+{}
 
 /**
  * A destructor which does nothing.
@@ -57,12 +80,25 @@ AVLNode<Key, Value>::AVLNode(const Key& key, const Value& value, AVLNode<Key, Va
 template<class Key, class Value>
 AVLNode<Key, Value>::~AVLNode() {}
 
+/**
+ * Copy with the same balance, tombstone flag and stored height.
+ */
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLNode<Key, Value>::clone() const {
+    AVLNode<Key, Value>* copy = new AVLNode<Key, Value>(this->getKey(), this->getValue(), nullptr);
+    copy->setTag(this->getTag());
+#ifdef AVL_STORE_HEIGHT
+    copy->height_ = height_;
+#endif
+    return copy;
+}
+
 /**
  * A getter for the balance of a AVLNode.
  */
 template<class Key, class Value>
 char AVLNode<Key, Value>::getBalance() const {
-    return balance_;
+    return (signed char)(this->getTag() & 0xff);
 }
 
 /**
@@ -70,7 +106,7 @@ char AVLNode<Key, Value>::getBalance() const {
  */
 template<class Key, class Value>
 void AVLNode<Key, Value>::setBalance(char balance) {
-    balance_ = balance;
+    this->setTag((this->getTag() & TOMBSTONE) | (unsigned char)balance);
 }
 
 /**
@@ -78,7 +114,41 @@ void AVLNode<Key, Value>::setBalance(char balance) {
  */
 template<class Key, class Value>
 void AVLNode<Key, Value>::updateBalance(char diff) {
-    balance_ += diff;
+    setBalance((char)(getBalance() + diff));
+}
+
+#ifdef AVL_STORE_HEIGHT
+/**
+ * A getter for the stored subtree height of a AVLNode.
+ */
+template<class Key, class Value>
+int AVLNode<Key, Value>::getHeight() const {
+    return height_;
+}
+
+/**
+ * A setter for the stored subtree height of a AVLNode.
+ */
+template<class Key, class Value>
+void AVLNode<Key, Value>::setHeight(int height) {
+    height_ = (unsigned short)height;
+}
+#endif
+
+/**
+ * Whether the node has been lazily deleted.
+ */
+template<class Key, class Value>
+bool AVLNode<Key, Value>::isTombstone() const {
+    return (this->getTag() & TOMBSTONE) != 0;
+}
+
+/**
+ * Marks or unmarks the node as lazily deleted.
+ */
+template<class Key, class Value>
+void AVLNode<Key, Value>::setTombstone(bool tombstone) {
+    this->setTag((this->getTag() & ~TOMBSTONE) | (tombstone ? TOMBSTONE : 0));
 }
 
 /**
@@ -87,7 +157,7 @@ void AVLNode<Key, Value>::updateBalance(char diff) {
  */
 template<class Key, class Value>
 AVLNode<Key, Value>* AVLNode<Key, Value>::getParent() const {
-    return static_cast<AVLNode<Key, Value>*>(this->parent_);
+    return static_cast<AVLNode<Key, Value>*>(Node<Key, Value>::getParent());
 }
 
 /**
@@ -95,7 +165,7 @@ AVLNode<Key, Value>* AVLNode<Key, Value>::getParent() const {
  */
 template<class Key, class Value>
 AVLNode<Key, Value>* AVLNode<Key, Value>::getLeft() const {
-    return static_cast<AVLNode<Key, Value>*>(this->left_);
+    return static_cast<AVLNode<Key, Value>*>(Node<Key, Value>::getLeft());
 }
 
 /**
@@ -103,7 +173,7 @@ AVLNode<Key, Value>* AVLNode<Key, Value>::getLeft() const {
  */
 template<class Key, class Value>
 AVLNode<Key, Value>* AVLNode<Key, Value>::getRight() const {
-    return static_cast<AVLNode<Key, Value>*>(this->right_);
+    return static_cast<AVLNode<Key, Value>*>(Node<Key, Value>::getRight());
 }
 
 /*
@@ -112,571 +182,559 @@ AVLNode<Key, Value>* AVLNode<Key, Value>::getRight() const {
   -----------------------------------------------
 */
 
-template<class Key, class Value>
+/**
+ * An AVL tree. MaxImbalance relaxes the balance bound to AVL(k): every
+ * node's subtree heights may differ by up to k (1 is the classic AVL
+ * tree). Larger k trades a taller worst case (about 1.44 log2 n for
+ * k = 1, 1.81 log2 n for k = 2, 2.16 log2 n for k = 3) for fewer
+ * rotations on updates.
+ */
+template<class Key, class Value, int MaxImbalance = 1>
 class AVLTree : public BinarySearchTree<Key, Value> {
+    static_assert(MaxImbalance >= 1 && MaxImbalance <= 100, "MaxImbalance must be in [1, 100]");
 public:
-    virtual void insert(const std::pair<const Key, Value>& new_item);  // TODO
+    AVLTree();
     virtual void remove(const Key& key);                               // TODO
+    virtual bool isBalanced() const override;
+
+    // Lazy deletion
+    void enableLazyDelete(double compactRatio = 0.25);
+    void disableLazyDelete();
+    void compact();
+    size_t tombstones() const;
 protected:
+    virtual Node<Key, Value>* insertAt(const NodeSearch<Key, Value>& found,
+                                       const std::pair<const Key, Value>& new_item) override;
     virtual void nodeSwap(AVLNode<Key, Value>* n1, AVLNode<Key, Value>* n2);
+    virtual NodeLayout nodeLayout() const override;
+    virtual int subtreeHeight(Node<Key, Value>* node) const override;
+    void updateHeight(AVLNode<Key, Value>* n);
+    virtual void rebuiltNode(Node<Key, Value>* node, int leftHeight, int rightHeight) override;
+    virtual Node<Key, Value>* joinTrees(Node<Key, Value>* left, int leftHeight, Node<Key, Value>* mid,
+                                        Node<Key, Value>* right, int rightHeight, int& height) override;
+    virtual int splitHeight(Node<Key, Value>* root) const override;
+    virtual int childHeight(Node<Key, Value>* node, int height, bool left) const override;
 
     // Add helper functions here
-    void insert_fix(AVLNode<Key, Value>* p, AVLNode<Key, Value>* n);
+    bool insert_fix(AVLNode<Key, Value>* p, AVLNode<Key, Value>* n);
     void remove_fix(AVLNode<Key, Value>* n, char diff);
+    int rebalance(AVLNode<Key, Value>* g);
     void rotateRight(AVLNode<Key, Value>* pivot);
     void rotateLeft(AVLNode<Key, Value>* pivot);
+
+    // Tombstone fraction of the linked nodes that triggers compact();
+    // zero when lazy deletion is off.
+    double compactRatio_;
 };
 
-/*
- * Recall: If key is already in the tree, you should
- * overwrite the current value with the updated value.
+template<class Key, class Value, int MaxImbalance>
+AVLTree<Key, Value, MaxImbalance>::AVLTree() : compactRatio_(0) {}
+
+/**
+ * Switches remove() to lazy deletion: it only marks the node, and all
+ * marked nodes are unlinked in one O(n) compact() once they make up more
+ * than compactRatio of the tree. Delete bursts then cost O(log n) for the
+ * lookup plus O(1/compactRatio) amortized, with no rotations. compact()
+ * can also be called directly, e.g. from an idle period.
+ *
+ * This is not a throughput win: the lookup dominates a remove, and an
+ * eager AVL remove averages well under one rotation. On bst-bench lazy
+ * (200k-key window, 50k-key bursts) removes take about 2.5x, 1.5x and
+ * 1.1x the eager time at ratios 0.1, 0.25 and 0.5 because of the
+ * compactions, and lookups are 15-50% slower: the tree carries its
+ * tombstones, and a rebuilt tree loses the memory locality of the top
+ * levels built by inserts. Even with compact() run outside the bursts, a
+ * marking remove costs about as much as an eager one. Use it when removes
+ * must not restructure the tree or removed keys are often re-inserted.
  */
-template<class Key, class Value>
-void AVLTree<Key, Value>::insert(const std::pair<const Key, Value>& new_item) {
-    // TODO
-    // Check to see if the node already in the tree
-    // If so just update the value of the node
-    Node<Key, Value>* found = this->internalFind(new_item.first);
-    if (found != nullptr) {
-        found->setValue(new_item.second);  // update value if already in tree
-        return;
+template<class Key, class Value, int MaxImbalance>
+void AVLTree<Key, Value, MaxImbalance>::enableLazyDelete(double compactRatio) {
+    if (compactRatio <= 0 || compactRatio > 1) {
+        throw std::invalid_argument("compactRatio must be in (0, 1]");
     }
-    // This holds the dynamic node to get updated as we find where
-    // it needs to be inserted
-    AVLNode<Key, Value>* newNode = new AVLNode<Key, Value>(new_item.first, new_item.second, nullptr);
-    if (this->root_ == nullptr) {
-        this->root_ = newNode;
-        return;
-    }
-
-    // This will hold a copy of the root so we can traverse
-    AVLNode<Key, Value>* current = static_cast<AVLNode<Key, Value>*>(this->root_);
+    compactRatio_ = compactRatio;
+}
 
-    // This will be the node where we find to insert the new item
-    AVLNode<Key, Value>* node = current;
+/**
+ * Compacts away any tombstones and goes back to removing immediately.
+ */
+template<class Key, class Value, int MaxImbalance>
+void AVLTree<Key, Value, MaxImbalance>::disableLazyDelete() {
+    compact();
+    compactRatio_ = 0;
+}
 
-    // While we can traverse
-    while (current != nullptr) {
-        // This will make sure we find the node before we
-        // get to the nullptr
-        node = current;
+/**
+ * Number of lazily deleted nodes still linked into the tree.
+ */
+template<class Key, class Value, int MaxImbalance>
+size_t AVLTree<Key, Value, MaxImbalance>::tombstones() const {
+    return this->tombstoneCount_;
+}
 
-        // If the key is less that the current key go left
-        if (new_item.first < current->getKey()) {
-            current = current->getLeft();
-        }
-        // If the key is greater than the current key go right
-        else if (new_item.first > current->getKey()) {
-            current = current->getRight();
-        }
+/**
+ * Frees every tombstoned node and relinks the rest as a perfectly
+ * balanced tree in one linear pass.
+ */
+template<class Key, class Value, int MaxImbalance>
+void AVLTree<Key, Value, MaxImbalance>::compact() {
+    if (this->tombstoneCount_ == 0) {
+        return;
     }
-    // If the key is less than the node go left
-    if (new_item.first < node->getKey()) {
-        // insert into the left child of the parent
-        node->setLeft(newNode);
-
-        // Make sure to update the parent
-        newNode->setParent(node);
-
-        // Checking the balance of the parent
-        if (node->getBalance() == -1) {
-            node->setBalance(0);
-            return;
+    std::vector<Node<Key, Value>*> nodes;
+    nodes.reserve(this->nodeCount_);
+    this->flattenSubtree(this->root_, nodes);
+
+    size_t live = 0;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        if (nodes[i]->isTombstone()) {
+            delete nodes[i];
+        } else {
+            nodes[live++] = nodes[i];
         }
+    }
+    nodes.resize(live);
+    this->nodeCount_ = live;
+    this->tombstoneCount_ = 0;
+    this->rightmost_ = nullptr;
+    this->root_ = this->linkBalanced(nodes, nullptr);
+}
 
-        if (node->getBalance() == 1) {
-            node->setBalance(0);
-            return;
+/*
+ * Recall: If key is already in the tree, you should
+ * overwrite the current value with the updated value.
+ */
+template<class Key, class Value, int MaxImbalance>
+Node<Key, Value>* AVLTree<Key, Value, MaxImbalance>::insertAt(const NodeSearch<Key, Value>& found,
+                                                              const std::pair<const Key, Value>& new_item) {
+    // TODO
+    // Check to see if the node already in the tree
+    // If so just update the value of the node
+    if (found.node != nullptr) {
+        found.node->setValue(new_item.second);  // update value if already in tree
+        if (found.node->isTombstone()) {
+            static_cast<AVLNode<Key, Value>*>(found.node)->setTombstone(false);
+            --this->tombstoneCount_;
         }
+        return found.node;
+    }
 
-        if (node->getBalance() == 0) {
-            node->updateBalance((signed char)-1);
-            return this->insert_fix(node, newNode);
-        }
+    // Link the new leaf where the search fell off the tree
+    AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(found.parent);
+    AVLNode<Key, Value>* newNode = new AVLNode<Key, Value>(new_item.first, new_item.second, node);
+    this->noteNodeAdded(newNode);
+    if (node == nullptr) {
+        this->root_ = newNode;
+        return newNode;
     }
-    // If the key is greater than the node go right
-    else if (new_item.first > node->getKey()) {
-        // Insert into the right child of the parent
+    if (found.left) {
+        node->setLeft(newNode);
+    } else {
         node->setRight(newNode);
-
-        // Make sure to update the parent
-        newNode->setParent(node);
-
-        // Checking the balance of the parent
-        if (node->getBalance() == -1) {
-            node->setBalance(0);
-            return;
-        }
-
-        if (node->getBalance() == 1) {
-            node->setBalance(0);
-            return;
-        }
-
-        if (node->getBalance() == 0) {
-            node->updateBalance(1);
-            return this->insert_fix(node, newNode);
-        }
     }
+    insert_fix(node, newNode);
+    return newNode;
 }
 
-// Function for inserting
-template<class Key, class Value>
-void AVLTree<Key, Value>::insert_fix(AVLNode<Key, Value>* p, AVLNode<Key, Value>* n) {
-    // If the current node or the current node is null just terminate the
-    // function
-    if (p == nullptr || p->getParent() == nullptr) {
-        return;
-    }
-
-    // Value to hold the g (grandparent) of n (inserted node)
-    AVLNode<Key, Value>* g = p->getParent();
-
-    // Checking if p is the left child of g
-    if (p == g->getLeft()) {
-        // Update the balance of grandparent
-        g->updateBalance(-1);
-
-        // Case 1
-        if (g->getBalance() == 0) {
-            return;
-        }
-
-        // Case 2
-        if (g->getBalance() == -1) {
-            insert_fix(g, p);
-            return;
+/*
+ * Retraces after n, a child of p, grew by one level: updates balances
+ * on the way up and stops as soon as a subtree's height is unchanged.
+ * A balance that leaves [-MaxImbalance, MaxImbalance] is fixed with one
+ * single or double rotation. Returns whether the whole tree grew.
+ */
+template<class Key, class Value, int MaxImbalance>
+bool AVLTree<Key, Value, MaxImbalance>::insert_fix(AVLNode<Key, Value>* p, AVLNode<Key, Value>* n) {
+    while (p != nullptr) {
+        BST_STAT(STAT_REBALANCE_STEPS, 1);
+        signed char diff = p->getLeft() == n ? -1 : 1;
+        int old = p->getBalance();
+        p->updateBalance(diff);
+        updateHeight(p);
+
+        // The shorter side caught up, so p's height did not change
+        if (old * diff < 0) {
+            return false;
         }
-
-        // Case 3
-        if (g->getBalance() == -2) {
-            // zig zig
-            if (n == p->getLeft()) {
-                rotateRight(g);
-                p->setBalance(0);
-                g->setBalance(0);
-            } else
-            // zig zag
-            {
-                rotateLeft(p);
-                rotateRight(g);
-                if (n->getBalance() == -1) {
-                    p->setBalance(0);
-                    g->setBalance(1);
-                    n->setBalance(0);
-                } else if (n->getBalance() == 0) {
-                    p->setBalance(0);
-                    g->setBalance(0);
-                    n->setBalance(0);
-                } else if (n->getBalance() == 1) {
-                    p->setBalance(-1);
-                    g->setBalance(0);
-                    n->setBalance(0);
-                }
+        if (std::abs(p->getBalance()) > MaxImbalance) {
+            // A rotation after an insert always restores the old height,
+            // but check rather than rely on it
+            if (rebalance(p) < 0) {
+                return false;
             }
+            p = p->getParent();
         }
-
+        n = p;
+        p = p->getParent();
     }
-    // Checking if p is the right child of g
-    else if (p == g->getRight()) {
-        // Update the balance of grandparent
-        g->updateBalance(1);
+    return true;
+}
 
-        // Case 1
-        if (g->getBalance() == 0) {
-            return;
+/*
+ * Retraces after n lost a level on one side (diff is +1 when its left
+ * subtree shrank, -1 for the right). Continues upward while subtree
+ * heights keep shrinking, rotating where a balance leaves the bound.
+ */
+template<class Key, class Value, int MaxImbalance>
+void AVLTree<Key, Value, MaxImbalance>::remove_fix(AVLNode<Key, Value>* n, char diff) {
+    while (n != nullptr) {
+        BST_STAT(STAT_REBALANCE_STEPS, 1);
+
+        // Which side of the parent n's subtree hangs on; rotations below
+        // keep the position even when n itself moves down
+        AVLNode<Key, Value>* parent = n->getParent();
+        signed char ndiff = 0;
+        if (parent != nullptr) {
+            ndiff = parent->getLeft() == n ? 1 : -1;
         }
 
-        // Case 2
-        if (g->getBalance() == 1) {
-            insert_fix(g, p);
+        int old = n->getBalance();
+        n->updateBalance(diff);
+        updateHeight(n);
+
+        // Was even: the other side still holds the height
+        if (old == 0) {
             return;
         }
-
-        // Case 3
-        if (g->getBalance() == 2) {
-            // zig zig
-            if (n == p->getRight()) {
-                rotateLeft(g);
-                p->setBalance(0);
-                g->setBalance(0);
-            }
-            // zig zag
-            else {
-                rotateRight(p);
-                rotateLeft(g);
-                if (n->getBalance() == 1) {
-                    p->setBalance(0);
-                    g->setBalance(-1);
-                    n->setBalance(0);
-                } else if (n->getBalance() == 0) {
-                    p->setBalance(0);
-                    g->setBalance(0);
-                    n->setBalance(0);
-                } else if (n->getBalance() == -1) {
-                    p->setBalance(1);
-                    g->setBalance(0);
-                    n->setBalance(0);
-                }
+        // The shorter side shrank: the height only changes via rotation
+        if (old * diff > 0) {
+            if (std::abs(n->getBalance()) <= MaxImbalance || rebalance(n) == 0) {
+                return;
             }
         }
+        n = parent;
+        diff = ndiff;
     }
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::remove_fix(AVLNode<Key, Value>* n, char diff) {
-    // If the node is empty return
-    signed char ndiff = 0;
-    if (n == nullptr) {
-        return;
-    }
-
-    AVLNode<Key, Value>* parent = n->getParent();
-
-    if (parent != nullptr) {
-        if (this->isLeft(parent, n)) {
-            ndiff = 1;
+/*
+ * Rotates g, whose balance is one past the bound, and returns the
+ * change in the subtree's height (0 or -1). Balances are recomputed from
+ * heights measured relative to g's heavy child c, in a frame mirrored so
+ * that the heavy side is the right, which keeps the formulas valid for
+ * any MaxImbalance.
+ */
+template<class Key, class Value, int MaxImbalance>
+int AVLTree<Key, Value, MaxImbalance>::rebalance(AVLNode<Key, Value>* g) {
+    int s = g->getBalance() > 0 ? 1 : -1;
+    AVLNode<Key, Value>* c = s > 0 ? g->getRight() : g->getLeft();
+
+    // h(c) = 0, so g's height is 1 and its light child is MaxImbalance + 1 lower
+    int hgL = -(MaxImbalance + 1);
+    int b = s * c->getBalance();
+    int hcR = b >= 0 ? -1 : -1 + b;
+    int hcL = b >= 0 ? -1 - b : -1;
+    int newHeight;
+
+    if (b >= 0) {
+        // c's heavy side is outside: single rotation, c on top
+        BST_STAT(STAT_SINGLE_ROTATIONS, 1);
+        int hg = 1 + std::max(hgL, hcL);
+        g->setBalance((signed char)(s * (hcL - hgL)));
+        c->setBalance((signed char)(s * (hcR - hg)));
+        newHeight = 1 + std::max(hg, hcR);
+        if (s > 0) {
+            rotateLeft(g);
         } else {
-            ndiff = -1;
-        }
-    }
-    if (diff == -1) {
-        if (n->getBalance() + diff == -2) {
-            AVLNode<Key, Value>* c = n->getLeft();
-            if (c->getBalance() == -1) {
-                rotateRight(n);
-                n->setBalance(0);
-                c->setBalance(0);
-                return this->remove_fix(parent, ndiff);
-            } else if (c->getBalance() == 0) {
-                rotateRight(n);
-                n->setBalance(-1);
-                c->setBalance(1);
-                return;
-            } else if (c->getBalance() == 1) {
-                AVLNode<Key, Value>* g = c->getRight();
-                rotateLeft(c);
-                rotateRight(n);
-                if (g->getBalance() == 1) {
-                    n->setBalance(0);
-                    c->setBalance(-1);
-                    g->setBalance(0);
-                } else if (g->getBalance() == 0) {
-                    n->setBalance(0);
-                    c->setBalance(0);
-                    g->setBalance(0);
-                } else if (g->getBalance() == -1) {
-                    n->setBalance(1);
-                    c->setBalance(0);
-                    g->setBalance(0);
-                }
-                return remove_fix(parent, ndiff);
-            }
-        } else if (n->getBalance() + diff == -1) {
-            n->setBalance(-1);
-            return;
-        } else if (n->getBalance() + diff == 0) {
-            n->setBalance(0);
-            return remove_fix(parent, ndiff);
+            rotateRight(g);
         }
-    } else if (diff == 1) {
-        if (n->getBalance() + diff == 2) {
-            AVLNode<Key, Value>* c = n->getRight();
-            if (c->getBalance() == 1) {
-                rotateLeft(n);
-                n->setBalance(0);
-                c->setBalance(0);
-                return remove_fix(parent, ndiff);
-            } else if (c->getBalance() == 0) {
-                rotateLeft(n);
-                n->setBalance(1);
-                c->setBalance(-1);
-                return;
-            } else if (c->getBalance() == -1) {
-                AVLNode<Key, Value>* g = c->getLeft();
-                rotateRight(c);
-                rotateLeft(n);
-                if (g->getBalance() == -1) {
-                    n->setBalance(0);
-                    c->setBalance(1);
-                    g->setBalance(0);
-                } else if (g->getBalance() == 0) {
-                    n->setBalance(0);
-                    c->setBalance(0);
-                    g->setBalance(0);
-                } else if (g->getBalance() == -1) {
-                    n->setBalance(-1);
-                    c->setBalance(0);
-                    g->setBalance(0);
-                }
-                return remove_fix(parent, ndiff);
-            }
-        } else if (n->getBalance() + diff == 1) {
-            n->setBalance(1);
-            return;
-        } else if (n->getBalance() + diff == 0) {
-            n->setBalance(0);
-            return remove_fix(parent, ndiff);
+    } else {
+        // c's heavy side is inside: double rotation, c's inner child d on top
+        BST_STAT(STAT_DOUBLE_ROTATIONS, 1);
+        AVLNode<Key, Value>* d = s > 0 ? c->getLeft() : c->getRight();
+        int e = s * d->getBalance();
+        int hdL = e >= 0 ? -2 - e : -2;
+        int hdR = e >= 0 ? -2 : -2 + e;
+        int hg = 1 + std::max(hgL, hdL);
+        int hc = 1 + std::max(hdR, hcR);
+        g->setBalance((signed char)(s * (hdL - hgL)));
+        c->setBalance((signed char)(s * (hcR - hdR)));
+        d->setBalance((signed char)(s * (hc - hg)));
+        newHeight = 1 + std::max(hg, hc);
+        if (s > 0) {
+            rotateRight(c);
+            rotateLeft(g);
+        } else {
+            rotateLeft(c);
+            rotateRight(g);
         }
     }
+    return newHeight - 1;
 }
 
-template<typename Key, typename Value>
-void AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* p) {
+template<class Key, class Value, int MaxImbalance>
+void AVLTree<Key, Value, MaxImbalance>::rotateRight(AVLNode<Key, Value>* p) {
     // variable to hold the left child of parent
     AVLNode<Key, Value>* leftChild = p->getLeft();
+    BinarySearchTree<Key, Value>::rotateRight(p);
 
-    // Update the left child
-    Node<Key, Value>* p_parent = p->getParent();
-    leftChild->setParent(p_parent);
-
-    // Update the parent
-    Node<Key, Value>* l_right = leftChild->getRight();
-    p->setLeft(l_right);
-
-    // If the left child of the parent is invalid
-    Node<Key, Value>* l_parent = p->getLeft();
-    if (l_parent != nullptr) {
-        l_parent->setParent(p);
-    }
-
-    // Update the right child of the left child
-    leftChild->setRight(p);
-    p->setParent(leftChild);
-
-    // Update the parent of the new parent node
-    if (leftChild->getParent() == nullptr) {
-        this->root_ = leftChild;
-    } else if (leftChild->getParent() != nullptr && leftChild->getParent()->getLeft() == p) {
-        leftChild->getParent()->setLeft(leftChild);
-    } else if (leftChild->getParent() != nullptr && leftChild->getParent()->getRight() == p) {
-        leftChild->getParent()->setRight(leftChild);
-    }
+    // p is now below its old left child
+    updateHeight(p);
+    updateHeight(leftChild);
 }
 
-template<typename Key, typename Value>
-void AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value>* p) {
+template<class Key, class Value, int MaxImbalance>
+void AVLTree<Key, Value, MaxImbalance>::rotateLeft(AVLNode<Key, Value>* p) {
     // Variable to hold the right child of the parent
     AVLNode<Key, Value>* rightChild = p->getRight();
+    BinarySearchTree<Key, Value>::rotateLeft(p);
 
-    // Update the right child
-    Node<Key, Value>* p_parent = p->getParent();
-    rightChild->setParent(p_parent);
-
-    // Update the parent
-    Node<Key, Value>* r_left = rightChild->getLeft();
-    p->setRight(r_left);
-
-    // If the right child is invalid
-    Node<Key, Value>* r_parent = p->getRight();
-    if (r_parent != nullptr) {
-        r_parent->setParent(p);
-    }
-
-    // Update the left child of the right child
-    rightChild->setLeft(p);
-    p->setParent(rightChild);
-
-    // Update the parent of the new parent node
-    if (rightChild->getParent() != nullptr && rightChild->getParent()->getLeft() == p) {
-        rightChild->getParent()->setLeft(rightChild);
-    } else if (rightChild->getParent() != nullptr && rightChild->getParent()->getRight() == p) {
-        rightChild->getParent()->setRight(rightChild);
-    } else if (rightChild->getParent() == nullptr) {
-        this->root_ = rightChild;
-    }
+    // p is now below its old right child
+    updateHeight(p);
+    updateHeight(rightChild);
 }
 
 /*
  * Recall: The writeup specifies that if a node has 2 children you
  * should swap with the predecessor and then remove.
  */
-template<class Key, class Value>
-void AVLTree<Key, Value>::remove(const Key& key) {
+template<class Key, class Value, int MaxImbalance>
+void AVLTree<Key, Value, MaxImbalance>::remove(const Key& key) {
     // TODO
+    BST_STAT(STAT_REMOVES, 1);
+    LatencyTimer timer(this->latency_ ? &this->latency_->local().remove : NULL);
+
     // variable to hold the node we found (if found)
     Node<Key, Value>* found = BinarySearchTree<Key, Value>::internalFind(key);
 
+    // If the item is not in the tree yet
+    if (found == nullptr || found->isTombstone()) {
+        return;
+    }
+
     // Making it into avl
     AVLNode<Key, Value>* current = static_cast<AVLNode<Key, Value>*>(found);
 
-    // Varaible to hold the parent of the current node
-    AVLNode<Key, Value>* p = current->getParent();
-
-    // Char to hold the diff
-    char diff = 0;
-
-    // If the item is not in the tree yet
-    if (current == nullptr || this->root_ == nullptr) {
+    // Lazy deletion only marks the node
+    if (compactRatio_ > 0) {
+        current->setTombstone(true);
+        ++this->tombstoneCount_;
+        if ((double)this->tombstoneCount_ > compactRatio_ * (double)this->nodeCount_) {
+            compact();
+        }
         return;
     }
 
-    // Case where the value has 0 children
-    if (current->getRight() == nullptr && current->getLeft() == nullptr) {
-        // If the item is the root
-        if (current == this->root_ && current != nullptr) {
-            this->root_ = nullptr;
-        } else if (current->getParent()->getLeft() == current)  // Left child
-        {
-            // If it is the left child, then set the parent's left child
-            // to null
-            current->getParent()->setLeft(nullptr);
-        } else if (current->getParent()->getRight() == current)  // right child
-        {
-            // If it is the right chiild, then set the parent's right child
-            // to null
-            current->getParent()->setRight(nullptr);
-        }
+    // If the node has two children swap it with its predecessor so
+    // that it has at most one child left
+    if (current->getRight() != nullptr && current->getLeft() != nullptr) {
+        Node<Key, Value>* finder = BinarySearchTree<Key, Value>::predecessor(current);
+        AVLNode<Key, Value>* pred = static_cast<AVLNode<Key, Value>*>(finder);
+        nodeSwap(current, pred);
+    }
 
-        // Checking for the balance of the parent
-        if (p != nullptr) {
-            // If left child
-            if (current->getParent()->getLeft() == current) {
-                diff = 1;
-            } else if (current->getParent()->getRight() == current) {
-                diff = (signed char)-1;
-            }
+    // The parent loses height on the side the node came from
+    AVLNode<Key, Value>* p = current->getParent();
+    char diff = 0;
+    if (p != nullptr) {
+        if (p->getLeft() == current) {
+            diff = 1;
+        } else {
+            diff = (signed char)-1;
         }
+    }
 
-        delete current;
-        return;
+    // Unlink the node, promoting its only child (if any)
+    this->spliceOut(current);
+
+    // Delete the node and rebalance from the parent up
+    this->noteNodeRemoved(current);
+    delete current;
+    remove_fix(p, diff);
+}
+
+template<class Key, class Value, int MaxImbalance>
+void AVLTree<Key, Value, MaxImbalance>::nodeSwap(AVLNode<Key, Value>* n1, AVLNode<Key, Value>* n2) {
+    BinarySearchTree<Key, Value>::nodeSwap(n1, n2);
+    char tempB = n1->getBalance();
+    n1->setBalance(n2->getBalance());
+    n2->setBalance(tempB);
+#ifdef AVL_STORE_HEIGHT
+    int tempH = n1->getHeight();
+    n1->setHeight(n2->getHeight());
+    n2->setHeight(tempH);
+#endif
+}
+
+/**
+ * AVL nodes are the size of a plain Node: the balance and tombstone flag
+ * sit in the tag bits of the child and parent links. With
+ * AVL_STORE_HEIGHT the stored subtree height adds two bytes on top.
+ */
+template<class Key, class Value, int MaxImbalance>
+NodeLayout AVLTree<Key, Value, MaxImbalance>::nodeLayout() const {
+#ifdef AVL_STORE_HEIGHT
+    return describeNode<AVLNode<Key, Value>, Key, Value>(3, sizeof(unsigned short));
+#else
+    // Balance and tombstone flag live in the link tag bits
+    return describeNode<AVLNode<Key, Value>, Key, Value>(3, 0);
+#endif
+}
+
+/**
+ * Recomputes the stored height of n from its children. Only does
+ * anything when heights are stored (AVL_STORE_HEIGHT).
+ */
+template<class Key, class Value, int MaxImbalance>
+void AVLTree<Key, Value, MaxImbalance>::updateHeight(AVLNode<Key, Value>* n) {
+#ifdef AVL_STORE_HEIGHT
+    int leftH = n->getLeft() != nullptr ? n->getLeft()->getHeight() : 0;
+    int rightH = n->getRight() != nullptr ? n->getRight()->getHeight() : 0;
+    n->setHeight(1 + std::max(leftH, rightH));
+#else
+    (void)n;
+#endif
+}
+
+/**
+ * Balances (and stored heights) of a subtree built by linkBalanced().
+ */
+template<class Key, class Value, int MaxImbalance>
+void AVLTree<Key, Value, MaxImbalance>::rebuiltNode(Node<Key, Value>* node, int leftHeight, int rightHeight) {
+    AVLNode<Key, Value>* n = static_cast<AVLNode<Key, Value>*>(node);
+    n->setBalance((signed char)(rightHeight - leftHeight));
+#ifdef AVL_STORE_HEIGHT
+    n->setHeight(1 + std::max(leftHeight, rightHeight));
+#endif
+}
+
+/**
+ * O(1) with stored heights. Otherwise the balance factors still point
+ * at the taller child, so following them down is O(log n).
+ */
+template<class Key, class Value, int MaxImbalance>
+int AVLTree<Key, Value, MaxImbalance>::subtreeHeight(Node<Key, Value>* node) const {
+    AVLNode<Key, Value>* n = static_cast<AVLNode<Key, Value>*>(node);
+#ifdef AVL_STORE_HEIGHT
+    return n != nullptr ? n->getHeight() : 0;
+#else
+    int height = 0;
+    while (n != nullptr) {
+        ++height;
+        n = n->getBalance() < 0 ? n->getLeft() : n->getRight();
     }
-    // If the node has one child and that child is the left node
-    else if (current->getRight() == nullptr && current->getLeft() != nullptr) {
-        // If current is the root
-        if (current == this->root_) {
-            // Promote the left child
-            this->root_ = this->root_->getLeft();
-
-            // Update the parent
-            this->root_->setParent(nullptr);
-        } else if (current->getParent()->getRight() == current)  // right child
-        {
-            // Make the left child of the current node the right child of the
-            // current node's parent
-            current->getParent()->setRight(current->getLeft());
-            current->getLeft()->setParent(current->getParent());
-        } else if (current->getParent()->getLeft() == current)  // left child
-        {
-            // Make the left child of the current node the left child of the
-            // current node's parent
-            current->getParent()->setLeft(current->getLeft());
-            current->getLeft()->setParent(current->getParent());
-        }
+    return height;
+#endif
+}
 
-        // Checking for the balance of the parent
-        if (p != nullptr) {
-            // If left child
-            if (current->getParent()->getLeft() == current) {
-                diff = 1;
-            } else if (current->getParent()->getRight() == current) {
-                diff = (signed char)-1;
-            }
-        }
+/**
+ * AVL join: when one side is more than MaxImbalance taller, mid goes
+ * down that side's inner spine to the first subtree no more than
+ * MaxImbalance taller than the other side, and the path above is fixed
+ * up as after an insert. O(difference in heights).
+ */
+template<class Key, class Value, int MaxImbalance>
+Node<Key, Value>* AVLTree<Key, Value, MaxImbalance>::joinTrees(Node<Key, Value>* left, int leftHeight,
+                                                               Node<Key, Value>* mid, Node<Key, Value>* right,
+                                                               int rightHeight, int& height) {
+    AVLNode<Key, Value>* x = static_cast<AVLNode<Key, Value>*>(mid);
+    bool leftTaller = leftHeight > rightHeight + MaxImbalance;
+    if (!leftTaller && rightHeight <= leftHeight + MaxImbalance) {
+        BinarySearchTree<Key, Value>::joinTrees(left, leftHeight, mid, right, rightHeight, height);
+        x->setBalance((signed char)(rightHeight - leftHeight));
+        updateHeight(x);
+        return x;
+    }
 
-        // Delete the node and return
-        delete current;
-        return;
+    // Walk the taller tree's inner spine down to height short + MaxImbalance
+    AVLNode<Key, Value>* tall = static_cast<AVLNode<Key, Value>*>(leftTaller ? left : right);
+    int shortHeight = leftTaller ? rightHeight : leftHeight;
+    AVLNode<Key, Value>* p = nullptr;
+    AVLNode<Key, Value>* c = tall;
+    int hc = leftTaller ? leftHeight : rightHeight;
+    while (hc > shortHeight + MaxImbalance) {
+        p = c;
+        hc = childHeight(c, hc, !leftTaller);
+        c = leftTaller ? c->getRight() : c->getLeft();
     }
-    // If the current node has one child and that child is the right node
-    else if (current->getRight() != nullptr && current->getLeft() == nullptr) {
-        if (current == this->root_) {
-            // Promote the child
-            this->root_ = this->root_->getRight();
-
-            // Update the parent
-            this->root_->setParent(nullptr);
-        } else if (current->getParent()->getRight() == current)  // right child
-        {
-            // Make the right child of the current node the the child
-            // of the current parent
-            current->getParent()->setRight(current->getRight());
-            current->getRight()->setParent(current->getParent());
-        } else if (current->getParent()->getLeft() == current)  // left child
-        {
-            // Make the left child of the current node the child
-            // pf the current's parent
-            current->getParent()->setLeft(current->getRight());
-            current->getRight()->setParent(current->getParent());
-        }
 
-        // Checking for the balance of the parent
-        if (p != nullptr) {
-            // If left child
-            if (current->getParent()->getLeft() == current) {
-                diff = 1;
-            } else if (current->getParent()->getRight() == current) {
-                diff = (signed char)-1;
-            }
-        }
+    // hc is now within [shortHeight, shortHeight + MaxImbalance], so the
+    // new subtree at x is one level taller than c was
+    if (leftTaller) {
+        BinarySearchTree<Key, Value>::joinTrees(c, hc, x, right, rightHeight, height);
+        x->setBalance((signed char)(rightHeight - hc));
+        p->setRight(x);
+    } else {
+        BinarySearchTree<Key, Value>::joinTrees(left, leftHeight, x, c, hc, height);
+        x->setBalance((signed char)(hc - leftHeight));
+        p->setLeft(x);
+    }
+    x->setParent(p);
+    updateHeight(x);
+
+    // Rotations at the top relink root_, so retrace with tall as the root
+    this->root_ = tall;
+    bool grew = insert_fix(p, x);
+    height = (leftTaller ? leftHeight : rightHeight) + (grew ? 1 : 0);
+    return this->root_;
+}
 
-        // Delete the node and return
-        delete current;
-        return;
+/**
+ * Range erase needs the heights of the pieces it joins; O(log n), or
+ * O(1) with stored heights.
+ */
+template<class Key, class Value, int MaxImbalance>
+int AVLTree<Key, Value, MaxImbalance>::splitHeight(Node<Key, Value>* root) const {
+    return subtreeHeight(root);
+}
+
+/**
+ * A child's height follows from the node's height and balance: the
+ * taller side is one lower, the other side lower by the balance too.
+ */
+template<class Key, class Value, int MaxImbalance>
+int AVLTree<Key, Value, MaxImbalance>::childHeight(Node<Key, Value>* node, int height, bool left) const {
+    int balance = static_cast<AVLNode<Key, Value>*>(node)->getBalance();
+    return height - 1 - std::max(0, left ? balance : -balance);
+}
+
+/**
+ * Checks every node in one iterative post-order pass: the stored balance
+ * (and height, with AVL_STORE_HEIGHT) must match the actual subtree
+ * heights and stay within the MaxImbalance bound.
+ */
+template<class Key, class Value, int MaxImbalance>
+bool AVLTree<Key, Value, MaxImbalance>::isBalanced() const {
+    std::vector<std::pair<AVLNode<Key, Value>*, bool> > stack;
+    std::vector<int> heights;
+    if (this->root_ != nullptr) {
+        stack.push_back(std::make_pair(static_cast<AVLNode<Key, Value>*>(this->root_), false));
     }
-    // If the node has two children
-    else if (current->getRight() != nullptr && current->getLeft() != nullptr) {
-        Node<Key, Value>* finder = BinarySearchTree<Key, Value>::predecessor(current);
-        AVLNode<Key, Value>* pred = static_cast<AVLNode<Key, Value>*>(finder);
-        nodeSwap(current, pred);
-        if (current->getLeft() != nullptr || current->getRight() != nullptr) {
-            if (current->getRight() != nullptr) {
-                if (current->getParent()->getRight() == current) {
-                    current->getParent()->setRight(current->getRight());
-                    current->getRight()->setParent(current->getParent());
-                } else {
-                    current->getParent()->setLeft(current->getRight());
-                    current->getRight()->setParent(current->getParent());
-                }
-            } else if (current->getLeft() != nullptr) {
-                if (current->getParent()->getRight() == current) {
-                    current->getParent()->setRight(current->getLeft());
-                    current->getLeft()->setParent(current->getParent());
-                } else {
-                    current->getParent()->setLeft(current->getLeft());
-                    current->getLeft()->setParent(current->getParent());
-                }
+    while (!stack.empty()) {
+        AVLNode<Key, Value>* n = stack.back().first;
+        bool childrenDone = stack.back().second;
+        stack.pop_back();
+        if (!childrenDone) {
+            stack.push_back(std::make_pair(n, true));
+            if (n->getRight() != nullptr) {
+                stack.push_back(std::make_pair(n->getRight(), false));
             }
-
-            // Checking for the balance of the parent
-            if (p != nullptr) {
-                // If left child
-                if (current->getParent()->getLeft() == current) {
-                    diff = 1;
-                } else if (current->getParent()->getRight() == current) {
-                    diff = (signed char)-1;
-                }
+            if (n->getLeft() != nullptr) {
+                stack.push_back(std::make_pair(n->getLeft(), false));
             }
-            delete current;
-            return;
+            continue;
         }
-
-        if (current->getParent()->getRight() == current) {
-            current->getParent()->setRight(nullptr);
+        // Children's heights are on top of the height stack, right above left
+        int rightH = 0;
+        int leftH = 0;
+        if (n->getRight() != nullptr) {
+            rightH = heights.back();
+            heights.pop_back();
         }
-        if (current->getParent()->getLeft() == current) {
-            current->getParent()->setLeft(nullptr);
+        if (n->getLeft() != nullptr) {
+            leftH = heights.back();
+            heights.pop_back();
         }
-
-        // Checking for the balance of the parent
-        if (p != nullptr) {
-            // If left child
-            if (current->getParent()->getLeft() == current) {
-                diff = 1;
-            } else if (current->getParent()->getRight() == current) {
-                diff = (signed char)-1;
-            }
+        if (n->getBalance() != rightH - leftH || std::abs(rightH - leftH) > MaxImbalance) {
+            return false;
+        }
+#ifdef AVL_STORE_HEIGHT
+        if (n->getHeight() != 1 + std::max(leftH, rightH)) {
+            return false;
         }
-        delete current;
+#endif
+        heights.push_back(1 + std::max(leftH, rightH));
     }
-}
-
-template<class Key, class Value>
-void AVLTree<Key, Value>::nodeSwap(AVLNode<Key, Value>* n1, AVLNode<Key, Value>* n2) {
-    BinarySearchTree<Key, Value>::nodeSwap(n1, n2);
-    char tempB = n1->getBalance();
-    n1->setBalance(n2->getBalance());
-    n2->setBalance(tempB);
+    return true;
 }
 
 #endif
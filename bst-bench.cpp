@@ -0,0 +1,1041 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bst.h"
+#include "avlbst.h"
+#include "rbtree.h"
+#include "splaybst.h"
+#include "scapegoatbst.h"
+#include "string-keys.h"
+#include "compact-avl.h"
+#include "parentless-avl.h"
+#include "mapped-avl.h"
+#include "shared-avl.h"
+
+using namespace std;
+
+// Tree benchmarks. Built with BST_STATS so rotation counts can be
+// reported next to the timings.
+//
+//   bst-bench [benchmark...]      (default: all)
+
+struct Op {
+    char kind;  // 'i'nsert, 'r'emove, 'f'ind
+    int key;
+};
+
+struct BenchResult {
+    double ms;
+    TreeStats stats;
+    ShapeReport shape;
+};
+
+// Counter deltas between two snapshots.
+TreeStats statsSince(const TreeStats& before)
+{
+    TreeStats now = treeStatsSnapshot();
+    for(int i = 0; i < STAT_COUNT; ++i)
+    {
+        now.counts[i] -= before.counts[i];
+    }
+    return now;
+}
+
+// n operations with the given insert/remove percentages (the rest are
+// finds) on uniformly random keys in [0, keyRange).
+vector<Op> makeMix(size_t n, int insertPct, int removePct, int keyRange, unsigned seed)
+{
+    mt19937 rng(seed);
+    vector<Op> ops(n);
+    for(size_t i = 0; i < n; ++i)
+    {
+        int roll = (int)(rng() % 100);
+        ops[i].kind = roll < insertPct ? 'i' : (roll < insertPct + removePct ? 'r' : 'f');
+        ops[i].key = (int)(rng() % (unsigned)keyRange);
+    }
+    return ops;
+}
+
+static volatile size_t findSink;
+
+template<typename Tree>
+BenchResult runOps(Tree& tree, const vector<Op>& ops)
+{
+    BenchResult result;
+    size_t found = 0;
+    TreeStats before = treeStatsSnapshot();
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < ops.size(); ++i)
+    {
+        if(ops[i].kind == 'i')
+        {
+            tree.insert(make_pair(ops[i].key, ops[i].key));
+        }
+        else if(ops[i].kind == 'r')
+        {
+            tree.remove(ops[i].key);
+        }
+        else if(tree.find(ops[i].key) != tree.end())
+        {
+            ++found;
+        }
+    }
+    result.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    result.stats = statsSince(before);
+    result.shape = tree.shapeReport();
+    findSink = found;  // keep the finds from being optimized away
+    return result;
+}
+
+void printHeader()
+{
+    cout << left << setw(14) << "workload" << setw(10) << "tree" << right << setw(10) << "ms" << setw(10)
+         << "Mops/s" << setw(12) << "rot/op" << setw(10) << "avgdepth" << setw(8) << "height" << endl;
+}
+
+void printRow(const string& workload, const string& tree, const BenchResult& r, size_t ops)
+{
+    double rotations = (double)(r.stats[STAT_SINGLE_ROTATIONS] + r.stats[STAT_DOUBLE_ROTATIONS]);
+    cout << left << setw(14) << workload << setw(10) << tree << right << fixed << setprecision(1) << setw(10)
+         << r.ms << setprecision(2) << setw(10) << ops / r.ms / 1000.0 << setprecision(3) << setw(12)
+         << rotations / ops << setprecision(2) << setw(10) << r.shape.averageDepth() << setw(8)
+         << r.shape.maxDepth + 1 << endl;
+}
+
+// Red-black vs AVL on insert-, delete- and read-heavy mixes. Each tree
+// is prefilled with the same keys and then runs the same operations.
+void benchRedBlack()
+{
+    const size_t n = 400000;
+    const int keyRange = 1000000;
+    struct Mix {
+        const char* name;
+        int insertPct;
+        int removePct;
+    };
+    const Mix mixes[] = { { "insert-heavy", 90, 5 }, { "delete-heavy", 20, 70 }, { "read-heavy", 5, 5 } };
+
+    cout << "== red-black vs AVL (" << n << " ops after " << n << " prefill inserts) ==" << endl;
+    printHeader();
+    vector<Op> prefill = makeMix(n, 100, 0, keyRange, 1);
+    for(size_t m = 0; m < sizeof(mixes) / sizeof(mixes[0]); ++m)
+    {
+        vector<Op> ops = makeMix(n, mixes[m].insertPct, mixes[m].removePct, keyRange, 2 + (unsigned)m);
+        {
+            AVLTree<int, int> avl;
+            runOps(avl, prefill);
+            printRow(mixes[m].name, "avl", runOps(avl, ops), n);
+        }
+        {
+            RedBlackTree<int, int> rb;
+            runOps(rb, prefill);
+            printRow(mixes[m].name, "rb", runOps(rb, ops), n);
+        }
+    }
+    cout << endl;
+}
+
+// n finds whose keys follow a Zipf distribution with exponent s over
+// [0, keyRange): rank r is drawn with probability proportional to
+// 1/r^s, and ranks are mapped to keys through a random permutation so
+// the hot keys are scattered over the key space.
+vector<Op> makeZipfFinds(size_t n, int keyRange, double s, unsigned seed)
+{
+    mt19937 rng(seed);
+    vector<double> cdf(keyRange);
+    double total = 0;
+    for(int r = 0; r < keyRange; ++r)
+    {
+        total += 1.0 / pow((double)(r + 1), s);
+        cdf[r] = total;
+    }
+    vector<int> keyOfRank(keyRange);
+    for(int r = 0; r < keyRange; ++r)
+    {
+        keyOfRank[r] = r;
+    }
+    shuffle(keyOfRank.begin(), keyOfRank.end(), rng);
+
+    uniform_real_distribution<double> uniform(0.0, total);
+    vector<Op> ops(n);
+    for(size_t i = 0; i < n; ++i)
+    {
+        size_t rank = lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin();
+        ops[i].kind = 'f';
+        ops[i].key = keyOfRank[min(rank, cdf.size() - 1)];
+    }
+    return ops;
+}
+
+// Splay variants vs AVL on Zipfian lookups over a tree holding every key
+// in the range. cmp/op is the average number of key comparisons per
+// find, rot/op the restructuring each lookup causes.
+void benchSplay()
+{
+    const int keyRange = 200000;
+    const size_t n = 1000000;
+    const double exponents[] = { 0.8, 1.0, 1.2 };
+    struct Variant {
+        const char* name;
+        unsigned period;
+        bool semi;
+    };
+    const Variant variants[] = { { "splay", 1, false }, { "splay/4", 4, false }, { "semi", 1, true } };
+
+    vector<Op> prefill(keyRange);
+    for(int k = 0; k < keyRange; ++k)
+    {
+        prefill[k].kind = 'i';
+        prefill[k].key = k;
+    }
+    shuffle(prefill.begin(), prefill.end(), mt19937(1));
+
+    cout << "== splay vs AVL (" << n << " Zipfian finds over " << keyRange << " keys) ==" << endl;
+    cout << left << setw(14) << "workload" << setw(10) << "tree" << right << setw(10) << "ms" << setw(10)
+         << "Mops/s" << setw(10) << "cmp/op" << setw(12) << "rot/op" << endl;
+    for(size_t e = 0; e < sizeof(exponents) / sizeof(exponents[0]); ++e)
+    {
+        ostringstream workload;
+        workload << "zipf s=" << exponents[e];
+        vector<Op> ops = makeZipfFinds(n, keyRange, exponents[e], 3 + (unsigned)e);
+        vector<pair<string, BenchResult> > rows;
+        {
+            AVLTree<int, int> avl;
+            runOps(avl, prefill);
+            rows.push_back(make_pair(string("avl"), runOps(avl, ops)));
+        }
+        for(size_t v = 0; v < sizeof(variants) / sizeof(variants[0]); ++v)
+        {
+            SplayTree<int, int> splay;
+            splay.setSplayPeriod(variants[v].period);
+            splay.setSemiSplay(variants[v].semi);
+            runOps(splay, prefill);
+            rows.push_back(make_pair(string(variants[v].name), runOps(splay, ops)));
+        }
+        for(size_t i = 0; i < rows.size(); ++i)
+        {
+            const BenchResult& r = rows[i].second;
+            double rotations = (double)(r.stats[STAT_SINGLE_ROTATIONS] + r.stats[STAT_DOUBLE_ROTATIONS]);
+            cout << left << setw(14) << workload.str() << setw(10) << rows[i].first << right << fixed
+                 << setprecision(1) << setw(10) << r.ms << setprecision(2) << setw(10) << n / r.ms / 1000.0
+                 << setw(10) << (double)r.stats[STAT_COMPARISONS] / n << setprecision(3) << setw(12)
+                 << rotations / n << endl;
+            cout.unsetf(ios::fixed);
+        }
+    }
+    cout << endl;
+}
+
+// Scapegoat vs AVL: time, depth and bytes per node on random and
+// ascending inserts followed by a read-heavy mix.
+void benchScapegoat()
+{
+    const size_t n = 400000;
+    const int keyRange = 1000000;
+    vector<Op> random = makeMix(n, 100, 0, keyRange, 1);
+    vector<Op> ascending(n);
+    for(size_t i = 0; i < n; ++i)
+    {
+        ascending[i].kind = 'i';
+        ascending[i].key = (int)i;
+    }
+    vector<Op> reads = makeMix(n, 5, 5, keyRange, 2);
+
+    cout << "== scapegoat vs AVL (" << n << " inserts, then " << n << " read-heavy ops) ==" << endl;
+    printHeader();
+    for(int asc = 0; asc < 2; ++asc)
+    {
+        const vector<Op>& fill = asc ? ascending : random;
+        string name = asc ? "ascending" : "random";
+        {
+            AVLTree<int, int> avl;
+            printRow(name, "avl", runOps(avl, fill), n);
+            printRow("read-heavy", "avl", runOps(avl, reads), n);
+            cout << "  bytes/node " << avl.memoryReport().node.totalBytes() << endl;
+        }
+        {
+            ScapegoatTree<int, int> sg;
+            printRow(name, "scapegoat", runOps(sg, fill), n);
+            printRow("read-heavy", "scapegoat", runOps(sg, reads), n);
+            cout << "  bytes/node " << sg.memoryReport().node.totalBytes() << ", rebuilds " << sg.rebuilds() << endl;
+        }
+    }
+    cout << endl;
+}
+
+// Eager vs lazy AVL deletion on bursts of removes: each round inserts a
+// batch of new keys and then expires the oldest batch, like a retention
+// window. The lazy rows include their compactions in the remove time;
+// the "idle" row never compacts on its own and instead calls compact()
+// after each burst, timed separately, as a server would when idle.
+void benchLazyDelete()
+{
+    const int window = 200000;
+    const int batch = 50000;
+    const int rounds = 8;
+    const double ratios[] = { 0, 0.1, 0.25, 0.5, 1.0 };
+
+    cout << "== eager vs lazy AVL remove (" << rounds << " bursts of " << batch << " removes, window " << window
+         << ") ==" << endl;
+    cout << left << setw(14) << "compactRatio" << right << setw(12) << "insert ms" << setw(12) << "remove ms"
+         << setw(12) << "compact ms" << setw(12) << "find ms" << setw(12) << "rot/remove" << setw(12) << "tombstones"
+         << endl;
+    mt19937 rng(5);
+    vector<int> keys(window + rounds * batch);
+    for(size_t i = 0; i < keys.size(); ++i)
+    {
+        keys[i] = (int)i;
+    }
+    shuffle(keys.begin(), keys.end(), rng);
+    vector<Op> finds = makeMix(window, 0, 0, (int)keys.size(), 6);
+
+    for(size_t r = 0; r < sizeof(ratios) / sizeof(ratios[0]); ++r)
+    {
+        AVLTree<int, int> avl;
+        if(ratios[r] > 0)
+        {
+            avl.enableLazyDelete(ratios[r]);
+        }
+        for(int i = 0; i < window; ++i)
+        {
+            avl.insert(make_pair(keys[i], i));
+        }
+        double insertMs = 0;
+        double removeMs = 0;
+        double findMs = 0;
+        double compactMs = 0;
+        TreeStats removeStats;
+        for(int round = 0; round < rounds; ++round)
+        {
+            vector<Op> inserts(batch);
+            vector<Op> removes(batch);
+            for(int i = 0; i < batch; ++i)
+            {
+                inserts[i].kind = 'i';
+                inserts[i].key = keys[window + round * batch + i];
+                removes[i].kind = 'r';
+                removes[i].key = keys[round * batch + i];
+            }
+            insertMs += runOps(avl, inserts).ms;
+            BenchResult removed = runOps(avl, removes);
+            removeMs += removed.ms;
+            removeStats += removed.stats;
+            if(ratios[r] == 1.0)
+            {
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                avl.compact();
+                compactMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            }
+            findMs += runOps(avl, finds).ms;
+        }
+        double rotations = (double)(removeStats[STAT_SINGLE_ROTATIONS] + removeStats[STAT_DOUBLE_ROTATIONS]);
+        ostringstream name;
+        name << (ratios[r] == 0 ? "eager " : ratios[r] == 1.0 ? "idle " : "") << ratios[r];
+        cout << left << setw(14) << name.str() << right << fixed << setprecision(1) << setw(12) << insertMs
+             << setw(12) << removeMs << setw(12) << compactMs << setw(12) << findMs << setprecision(3) << setw(12)
+             << rotations / (rounds * batch) << setw(12) << avl.tombstones() << endl;
+        cout.unsetf(ios::fixed);
+    }
+    cout << endl;
+}
+
+// One AVL(k) row pair for benchAvlK: a write-heavy mix, then lookups
+// on the resulting tree.
+template<int K>
+void runAvlK(const vector<Op>& writes, const vector<Op>& reads)
+{
+    AVLTree<int, int, K> avl;
+    ostringstream name;
+    name << "avl(" << K << ")";
+    printRow("write-heavy", name.str(), runOps(avl, writes), writes.size());
+    printRow("lookups", name.str(), runOps(avl, reads), reads.size());
+}
+
+// Sweeps the AVL balance bound k against rotations and lookup depth.
+void benchAvlK()
+{
+    const size_t n = 600000;
+    const int keyRange = 1000000;
+    vector<Op> writes = makeMix(n, 70, 25, keyRange, 7);
+    vector<Op> reads = makeMix(n, 0, 0, keyRange, 8);
+
+    cout << "== AVL(k) balance bound sweep (" << n << " ops 70% insert / 25% remove, then " << n
+         << " finds) ==" << endl;
+    printHeader();
+    runAvlK<1>(writes, reads);
+    runAvlK<2>(writes, reads);
+    runAvlK<3>(writes, reads);
+    runAvlK<4>(writes, reads);
+    runAvlK<8>(writes, reads);
+    cout << endl;
+}
+
+// Plain BST with and without auto-rebuild vs AVL on ascending inserts
+// followed by random lookups. The plain tree degenerates into a list,
+// so it only runs at the small size.
+void benchAutoRebuild()
+{
+    const size_t sizes[] = { 20000, 1000000 };
+    cout << "== auto-rebuilding BST on ascending inserts ==" << endl;
+    printHeader();
+    for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+    {
+        size_t n = sizes[i];
+        vector<Op> ascending(n);
+        for(size_t k = 0; k < n; ++k)
+        {
+            ascending[k].kind = 'i';
+            ascending[k].key = (int)k;
+        }
+        vector<Op> reads = makeMix(n, 0, 0, (int)n, 9);
+        ostringstream label;
+        label << "asc " << n;
+        if(n <= 20000)
+        {
+            BinarySearchTree<int, int> plain;
+            printRow(label.str(), "bst", runOps(plain, ascending), n);
+            printRow("lookups", "bst", runOps(plain, reads), n);
+        }
+        {
+            BinarySearchTree<int, int> rebuilt;
+            rebuilt.enableAutoRebuild(2.0);
+            printRow(label.str(), "bst+auto", runOps(rebuilt, ascending), n);
+            printRow("lookups", "bst+auto", runOps(rebuilt, reads), n);
+        }
+        {
+            AVLTree<int, int> avl;
+            printRow(label.str(), "avl", runOps(avl, ascending), n);
+            printRow("lookups", "avl", runOps(avl, reads), n);
+        }
+    }
+    cout << endl;
+}
+
+// One row of benchHints: time and key comparisons per operation.
+void printHintRow(const string& workload, const string& variant, double ms, const TreeStats& stats, size_t ops)
+{
+    cout << left << setw(14) << workload << setw(16) << variant << right << fixed << setprecision(1) << setw(10)
+         << ms << setprecision(2) << setw(10) << ops / ms / 1000.0 << setw(10)
+         << (double)stats[STAT_COMPARISONS] / ops << endl;
+    cout.unsetf(ios::fixed);
+}
+
+// AVL inserts of ascending timestamps and lookups in ascending order,
+// from the root vs from a hint (end() or the previous result).
+void benchHints()
+{
+    const size_t n = 1000000;
+    mt19937 rng(17);
+    vector<int> keys(n);
+    int t = 0;
+    for(size_t i = 0; i < n; ++i)
+    {
+        t += 1 + (int)(rng() % 3);
+        keys[i] = t;
+    }
+    // Lookups walk forward in small steps, hitting about a third
+    vector<int> probes(n);
+    for(size_t i = 0; i < n; ++i)
+    {
+        probes[i] = (int)i * 2 + (int)(rng() % 2);
+    }
+
+    cout << "== insert/find with hints (" << n << " ascending timestamps) ==" << endl;
+    cout << left << setw(14) << "workload" << setw(16) << "variant" << right << setw(10) << "ms" << setw(10)
+         << "Mops/s" << setw(10) << "cmp/op" << endl;
+    for(int variant = 0; variant < 3; ++variant)
+    {
+        AVLTree<int, int> avl;
+        const char* name = variant == 0 ? "root" : (variant == 1 ? "hint end()" : "hint previous");
+        TreeStats before = treeStatsSnapshot();
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        AVLTree<int, int>::iterator hint = avl.end();
+        for(size_t i = 0; i < n; ++i)
+        {
+            if(variant == 0)
+            {
+                avl.insert(make_pair(keys[i], (int)i));
+            }
+            else
+            {
+                hint = avl.insert(variant == 1 ? avl.end() : hint, make_pair(keys[i], (int)i));
+            }
+        }
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        printHintRow("append", name, ms, statsSince(before), n);
+
+        if(variant == 1)
+        {
+            continue;
+        }
+        size_t found = 0;
+        before = treeStatsSnapshot();
+        start = chrono::steady_clock::now();
+        AVLTree<int, int>::iterator last = avl.begin();
+        for(size_t i = 0; i < n; ++i)
+        {
+            AVLTree<int, int>::iterator it = variant == 0 ? avl.find(probes[i]) : avl.find(last, probes[i]);
+            if(it != avl.end())
+            {
+                last = it;
+                ++found;
+            }
+        }
+        ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        findSink = found;
+        printHintRow("nearby find", name, ms, statsSince(before), n);
+    }
+    cout << endl;
+}
+
+// Retention deletes on an AVL tree of timestamps: drop the oldest keys
+// in batches, and cut slices out of the middle, one remove() per key
+// vs one eraseRange() per batch.
+void benchRange()
+{
+    const size_t n = 1000000;
+    const size_t batch = 10000;
+    const int rounds = 50;
+
+    cout << "== range erase (" << n << " keys, " << rounds << " batches of " << batch << ") ==" << endl;
+    cout << left << setw(14) << "workload" << setw(16) << "variant" << right << setw(10) << "ms" << setw(12)
+         << "Mkeys/s" << setw(12) << "rotations" << endl;
+    for(int middle = 0; middle < 2; ++middle)
+    {
+        for(int ranged = 0; ranged < 2; ++ranged)
+        {
+            AVLTree<int, int> avl;
+            AVLTree<int, int>::iterator hint = avl.end();
+            for(size_t i = 0; i < n; ++i)
+            {
+                hint = avl.insert(hint, make_pair((int)i, (int)i));
+            }
+            TreeStats before = treeStatsSnapshot();
+            size_t erased = 0;
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            for(int r = 0; r < rounds; ++r)
+            {
+                // Oldest first, or slices spread over the key range
+                int low = middle ? (int)((size_t)r * (n / rounds)) : (int)((size_t)r * batch);
+                int high = low + (int)batch;
+                if(ranged)
+                {
+                    erased += avl.eraseRange(low, high);
+                }
+                else
+                {
+                    for(int k = low; k < high; ++k)
+                    {
+                        avl.remove(k);
+                        ++erased;
+                    }
+                }
+            }
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            TreeStats stats = statsSince(before);
+            cout << left << setw(14) << (middle ? "slices" : "oldest") << setw(16)
+                 << (ranged ? "eraseRange" : "remove loop") << right << fixed << setprecision(1) << setw(10) << ms
+                 << setprecision(2) << setw(12) << erased / ms / 1000.0 << setw(12)
+                 << stats[STAT_SINGLE_ROTATIONS] + stats[STAT_DOUBLE_ROTATIONS] << endl;
+            cout.unsetf(ios::fixed);
+        }
+    }
+    cout << endl;
+}
+
+// Cloning a random AVL tree: re-inserting every item, the structural
+// copy constructor, and the same copy split across threads.
+void benchCopy()
+{
+    const size_t n = 2000000;
+    mt19937 rng(19);
+    AVLTree<int, int> source;
+    for(size_t i = 0; i < n; ++i)
+    {
+        source.insert(make_pair((int)rng(), (int)i));
+    }
+
+    cout << "== copy (" << source.size() << " nodes, " << thread::hardware_concurrency()
+         << " hardware threads) ==" << endl;
+    cout << left << setw(16) << "variant" << right << setw(10) << "ms" << setw(12) << "Mnodes/s" << setw(10)
+         << "height" << endl;
+    for(int variant = 0; variant < 3; ++variant)
+    {
+        const char* name = variant == 0 ? "re-insert" : (variant == 1 ? "copy" : "copy, 4 threads");
+        if(variant == 2)
+        {
+            source.enableParallelCopy(4);
+        }
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        AVLTree<int, int>* copy;
+        if(variant == 0)
+        {
+            copy = new AVLTree<int, int>();
+            for(AVLTree<int, int>::iterator it = source.begin(); it != source.end(); ++it)
+            {
+                copy->insert(*it);
+            }
+        }
+        else
+        {
+            copy = new AVLTree<int, int>(source);
+        }
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cout << left << setw(16) << name << right << fixed << setprecision(1) << setw(10) << ms << setprecision(2)
+             << setw(12) << copy->size() / ms / 1000.0 << setw(10) << copy->height() << endl;
+        cout.unsetf(ios::fixed);
+        delete copy;
+    }
+    cout << endl;
+}
+
+// Combining two AVL trees with interleaved keys: inserting the smaller
+// one's items into the larger vs merge().
+void benchMerge()
+{
+    const size_t n = 1000000;
+    cout << "== merge (" << n << " + " << n / 2 << " interleaved keys) ==" << endl;
+    cout << left << setw(16) << "variant" << right << setw(10) << "ms" << setw(12) << "cmp" << setw(10)
+         << "height" << endl;
+    for(int merged = 0; merged < 2; ++merged)
+    {
+        AVLTree<int, int> big;
+        AVLTree<int, int> small;
+        AVLTree<int, int>::iterator hint = big.end();
+        for(size_t i = 0; i < n; ++i)
+        {
+            hint = big.insert(hint, make_pair((int)i * 2, (int)i));
+        }
+        hint = small.end();
+        for(size_t i = 0; i < n / 2; ++i)
+        {
+            hint = small.insert(hint, make_pair((int)i * 4 + 1, (int)i));
+        }
+        TreeStats before = treeStatsSnapshot();
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        if(merged)
+        {
+            big.merge(small);
+        }
+        else
+        {
+            for(AVLTree<int, int>::iterator it = small.begin(); it != small.end(); ++it)
+            {
+                big.insert(*it);
+            }
+            small.clear();
+        }
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cout << left << setw(16) << (merged ? "merge" : "insert each") << right << fixed << setprecision(1)
+             << setw(10) << ms << setw(12) << statsSince(before)[STAT_COMPARISONS] << setw(10) << big.height()
+             << endl;
+        cout.unsetf(ios::fixed);
+    }
+    cout << endl;
+}
+
+// A std::string key that hides its type from KeySearch, so descents
+// use plain full-length comparisons. Baseline for benchStringKeys.
+struct PlainString {
+    string s;
+    bool operator<(const PlainString& o) const { return s < o.s; }
+    bool operator>(const PlainString& o) const { return s > o.s; }
+};
+
+ostream& operator<<(ostream& out, const PlainString& key)
+{
+    return out << key.s;
+}
+
+// URL-like keys with long shared prefixes.
+vector<string> makeUrls(size_t n, unsigned seed)
+{
+    static const char* hosts[] = { "https://www.example.com/", "https://static.example.com/", "https://api.example.org/" };
+    mt19937 rng(seed);
+    vector<string> urls(n);
+    for(size_t i = 0; i < n; ++i)
+    {
+        ostringstream url;
+        url << hosts[rng() % 3] << "catalog/v2/products/category-" << rng() % 20 << "/items/" << rng() % 1000000
+            << "?session=" << rng() % 100;
+        urls[i] = url.str();
+    }
+    return urls;
+}
+
+struct StringRun {
+    double insertMs;
+    double findMs;
+    size_t nodeBytes;
+    size_t keyBytes;
+};
+
+// Inserts keys[i] (stored through store()) and then finds every key.
+template<typename Key, typename Store>
+StringRun runStringKeys(const vector<Key>& keys, Store store)
+{
+    StringRun run;
+    AVLTree<Key, int> tree;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < keys.size(); ++i)
+    {
+        if(tree.find(keys[i]) == tree.end())
+        {
+            tree.insert(make_pair(store(keys[i]), (int)i));
+        }
+    }
+    run.insertMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    size_t found = 0;
+    start = chrono::steady_clock::now();
+    for(size_t i = 0; i < keys.size(); ++i)
+    {
+        found += tree.find(keys[i]) != tree.end();
+    }
+    run.findMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    findSink = found;
+    run.nodeBytes = tree.memoryReport().liveBytes();
+    run.keyBytes = 0;
+    return run;
+}
+
+template<typename Key>
+struct CopyKey {
+    Key operator()(const Key& key) const { return key; }
+};
+
+// Copies a key viewed in place into the arena.
+struct ArenaStore {
+    StringKeyArena* arena;
+    ArenaKey operator()(const ArenaKey& view) const
+    {
+        return arena->store(view.data(), view.size());
+    }
+};
+
+void printStringRun(const char* name, const StringRun& run)
+{
+    cout << left << setw(14) << name << right << fixed << setprecision(1) << setw(12) << run.insertMs << setw(12)
+         << run.findMs << setw(14) << run.nodeBytes << setw(14) << run.keyBytes << endl;
+    cout.unsetf(ios::fixed);
+}
+
+// URL keys: full-compare descent vs prefix-skipping descent vs arena
+// keys. Key bytes count the std::string heap blocks (rounded like
+// malloc) or the arena's chunks.
+void benchStringKeys()
+{
+    const size_t n = 300000;
+    vector<string> urls = makeUrls(n, 11);
+    vector<PlainString> plainUrls(n);
+    vector<ArenaKey> views(n);
+    size_t heapBytes = 0;
+    for(size_t i = 0; i < n; ++i)
+    {
+        plainUrls[i].s = urls[i];
+        views[i] = ArenaKey(urls[i]);
+        heapBytes += urls[i].size() > 15 ? mallocChunkBytes(urls[i].size() + 1) : 0;
+    }
+
+    cout << "== URL string keys (" << n << " keys, ~" << urls[0].size() << " bytes, inserted then found) ==" << endl;
+    cout << left << setw(14) << "keys" << right << setw(12) << "insert ms" << setw(12) << "find ms" << setw(14)
+         << "node bytes" << setw(14) << "key bytes" << endl;
+    // Where the heap puts nodes matters as much as the comparisons, so
+    // each variant runs once in every position and keeps its best times
+    StringRun best[3];
+    for(int round = 0; round < 3; ++round)
+    {
+        for(int slot = 0; slot < 3; ++slot)
+        {
+            int variant = (round + slot) % 3;
+            StringRun run;
+            if(variant == 0)
+            {
+                run = runStringKeys(plainUrls, CopyKey<PlainString>());
+                run.keyBytes = heapBytes;
+            }
+            else if(variant == 1)
+            {
+                run = runStringKeys(urls, CopyKey<string>());
+                run.keyBytes = heapBytes;
+            }
+            else
+            {
+                StringKeyArena arena;
+                ArenaStore store = { &arena };
+                run = runStringKeys(views, store);
+                run.keyBytes = arena.bytesReserved();
+            }
+            if(round == 0 || run.insertMs < best[variant].insertMs)
+            {
+                best[variant].insertMs = run.insertMs;
+            }
+            if(round == 0 || run.findMs < best[variant].findMs)
+            {
+                best[variant].findMs = run.findMs;
+            }
+            best[variant].nodeBytes = run.nodeBytes;
+            best[variant].keyBytes = run.keyBytes;
+        }
+    }
+    StringRun& plain = best[0];
+    StringRun& prefix = best[1];
+    StringRun& pooled = best[2];
+    printStringRun("full compare", plain);
+    printStringRun("prefix skip", prefix);
+    printStringRun("arena", pooled);
+    cout << endl;
+}
+
+// Pointer-linked AVL vs the index-linked CompactAVLTree on the same
+// inserts, lookups and a mixed phase, with bytes per node.
+void benchCompact()
+{
+    const size_t n = 1000000;
+    const int keyRange = 4000000;
+    vector<Op> fill = makeMix(n, 100, 0, keyRange, 11);
+    vector<Op> reads = makeMix(n, 0, 0, keyRange, 12);
+    vector<Op> mixed = makeMix(n, 25, 25, keyRange, 13);
+
+    cout << "== AVL vs compact AVL (" << n << " inserts, " << n << " finds, " << n << " mixed ops) ==" << endl;
+    printHeader();
+    {
+        AVLTree<int, int> avl;
+        printRow("insert", "avl", runOps(avl, fill), n);
+        printRow("find", "avl", runOps(avl, reads), n);
+        printRow("mixed", "avl", runOps(avl, mixed), n);
+        MemoryReport memory = avl.memoryReport();
+        cout << "  bytes/node " << memory.node.totalBytes() << ", live MiB " << fixed << setprecision(1)
+             << memory.liveBytes() / 1048576.0 << endl;
+        cout.unsetf(ios::fixed);
+    }
+    {
+        CompactAVLTree<int, int> compact;
+        printRow("insert", "compact", runOps(compact, fill), n);
+        printRow("find", "compact", runOps(compact, reads), n);
+        printRow("mixed", "compact", runOps(compact, mixed), n);
+        MemoryReport memory = compact.memoryReport();
+        cout << "  bytes/node " << memory.node.totalBytes() << ", live MiB " << fixed << setprecision(1)
+             << memory.liveBytes() / 1048576.0 << ", array MiB " << compact.capacityBytes() / 1048576.0 << endl;
+        cout.unsetf(ios::fixed);
+    }
+    cout << endl;
+}
+
+// The compact AVL tree in memory vs in a memory-mapped file, plus the
+// cost of a checkpoint and of reopening the file.
+void benchMapped()
+{
+    const size_t n = 1000000;
+    const int keyRange = 4000000;
+    vector<Op> fill = makeMix(n, 100, 0, keyRange, 11);
+    vector<Op> reads = makeMix(n, 0, 0, keyRange, 12);
+    vector<Op> mixed = makeMix(n, 25, 25, keyRange, 13);
+    ostringstream path;
+    path << "/tmp/bst-bench-" << getpid() << ".tree";
+
+    cout << "== compact AVL in memory vs mapped file (" << n << " inserts, " << n << " finds, " << n
+         << " mixed ops) ==" << endl;
+    printHeader();
+    {
+        CompactAVLTree<int, int> compact;
+        printRow("insert", "compact", runOps(compact, fill), n);
+        printRow("find", "compact", runOps(compact, reads), n);
+        printRow("mixed", "compact", runOps(compact, mixed), n);
+    }
+    size_t size;
+    {
+        MappedAVLTree<int, int> mapped(path.str());
+        printRow("insert", "mapped", runOps(mapped, fill), n);
+        printRow("find", "mapped", runOps(mapped, reads), n);
+        printRow("mixed", "mapped", runOps(mapped, mixed), n);
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        mapped.checkpoint();
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        size = mapped.size();
+        cout << "  checkpoint " << fixed << setprecision(1) << ms << " ms, file MiB "
+             << mapped.fileBytes() / 1048576.0 << endl;
+        cout.unsetf(ios::fixed);
+    }
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    {
+        MappedAVLTree<int, int> reopened(path.str());
+        findSink = reopened.find(reads[0].key) != reopened.end();
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cout << "  reopen + first find " << fixed << setprecision(2) << ms << " ms, size " << reopened.size()
+             << (reopened.size() == size ? " (same)" : " (DIFFERS)") << endl;
+        cout.unsetf(ios::fixed);
+    }
+    unlink(path.str().c_str());
+    cout << endl;
+}
+
+// Lookups through a SharedAVLReader (seqlock-checked, as another process
+// would do them) vs a private CompactAVLTree, idle and with the writer
+// publishing bursts of updates on another thread, and the memory one
+// shared copy saves.
+void benchShared()
+{
+    const size_t n = 1000000;
+    const int keyRange = 4000000;
+    const unsigned workers = 16;
+    vector<Op> fill = makeMix(n, 100, 0, keyRange, 11);
+    vector<Op> reads = makeMix(n, 0, 0, keyRange, 12);
+    vector<Op> updates = makeMix(n, 50, 50, keyRange, 13);
+    ostringstream name;
+    name << "/bst-bench-" << getpid();
+
+    cout << "== shared-memory tree (" << n << " keys, " << n << " lookups) ==" << endl;
+    cout << left << setw(24) << "variant" << right << setw(10) << "ms" << setw(10) << "Mops/s" << endl;
+    SharedAVLTree<int, int>::unlink(name.str());
+    SharedAVLTree<int, int> writer(name.str());
+    CompactAVLTree<int, int> local;
+    for(size_t i = 0; i < n; ++i)
+    {
+        writer.insert(make_pair(fill[i].key, (int)i));
+        local.insert(make_pair(fill[i].key, (int)i));
+    }
+    SharedAVLReader<int, int> reader(name.str());
+    for(int variant = 0; variant < 3; ++variant)
+    {
+        const char* label = variant == 0 ? "private compact" : (variant == 1 ? "shared reader" : "shared reader + writer");
+        atomic<bool> done(false);
+        size_t published = 0;
+        thread updater;
+        if(variant == 2)
+        {
+            updater = thread([&]() {
+                // Read-mostly: 100 updates per millisecond
+                for(size_t i = 0; !done.load(); i = (i + 1) % n)
+                {
+                    if(updates[i].kind == 'i')
+                    {
+                        writer.insert(make_pair(updates[i].key, (int)i));
+                    }
+                    else
+                    {
+                        writer.remove(updates[i].key);
+                    }
+                    if(++published % 100 == 0)
+                    {
+                        this_thread::sleep_for(chrono::milliseconds(1));
+                    }
+                }
+            });
+        }
+        size_t found = 0;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for(size_t i = 0; i < n; ++i)
+        {
+            int value;
+            found += variant == 0 ? local.find(reads[i].key) != local.end() : reader.find(reads[i].key, value);
+        }
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        done = true;
+        if(updater.joinable())
+        {
+            updater.join();
+        }
+        findSink = found;
+        cout << left << setw(24) << label << right << fixed << setprecision(1) << setw(10) << ms << setprecision(2)
+             << setw(10) << n / ms / 1000.0;
+        if(variant == 2)
+        {
+            cout << "  (" << published << " updates)";
+        }
+        cout << endl;
+        cout.unsetf(ios::fixed);
+    }
+    AVLTree<int, int> perProcess;
+    double privateMiB = perProcess.memoryReport().node.totalBytes() * (double)writer.size() / 1048576.0;
+    cout << "  " << workers << " workers: one segment " << fixed << setprecision(1)
+         << writer.segmentBytes() / 1048576.0 << " MiB vs " << workers << " private AVLTrees "
+         << privateMiB * workers << " MiB" << endl;
+    cout.unsetf(ios::fixed);
+    SharedAVLTree<int, int>::unlink(name.str());
+    cout << endl;
+}
+
+// One tree type for benchNodes: layout, then insert, find and mixed
+// timings on the shared operation lists.
+template<typename Tree>
+void runNodeLayout(const string& name, const vector<Op>& fill, const vector<Op>& reads, const vector<Op>& mixed)
+{
+    Tree tree;
+    printRow("insert", name, runOps(tree, fill), fill.size());
+    printRow("find", name, runOps(tree, reads), reads.size());
+    printRow("mixed", name, runOps(tree, mixed), mixed.size());
+    tree.memoryReport().print(cout);
+}
+
+// Per-node bytes and throughput of the pointer-linked node types,
+// including the AVL tree without parent pointers.
+void benchNodes()
+{
+    const size_t n = 1000000;
+    const int keyRange = 4000000;
+    vector<Op> fill = makeMix(n, 100, 0, keyRange, 14);
+    vector<Op> reads = makeMix(n, 0, 0, keyRange, 15);
+    vector<Op> mixed = makeMix(n, 25, 25, keyRange, 16);
+
+    cout << "== node layouts (" << n << " inserts, " << n << " finds, " << n << " mixed ops) ==" << endl;
+    printHeader();
+    runNodeLayout<BinarySearchTree<int, int> >("bst", fill, reads, mixed);
+    runNodeLayout<AVLTree<int, int> >("avl", fill, reads, mixed);
+    runNodeLayout<RedBlackTree<int, int> >("rbtree", fill, reads, mixed);
+    runNodeLayout<ParentlessAVLTree<int, int> >("parentless", fill, reads, mixed);
+    cout << endl;
+}
+
+struct Benchmark {
+    const char* name;
+    void (*run)();
+};
+
+static const Benchmark benchmarks[] = {
+    { "rbtree", benchRedBlack },
+    { "splay", benchSplay },
+    { "scapegoat", benchScapegoat },
+    { "lazy", benchLazyDelete },
+    { "avlk", benchAvlK },
+    { "rebuild", benchAutoRebuild },
+    { "strings", benchStringKeys },
+    { "compact", benchCompact },
+    { "nodes", benchNodes },
+    { "hints", benchHints },
+    { "range", benchRange },
+    { "copy", benchCopy },
+    { "merge", benchMerge },
+    { "mapped", benchMapped },
+    { "shared", benchShared },
+};
+
+int main(int argc, char* argv[])
+{
+    const size_t count = sizeof(benchmarks) / sizeof(benchmarks[0]);
+    for(size_t b = 0; b < count; ++b)
+    {
+        bool selected = argc < 2;
+        for(int a = 1; a < argc; ++a)
+        {
+            if(strcmp(argv[a], benchmarks[b].name) == 0)
+            {
+                selected = true;
+            }
+        }
+        if(selected)
+        {
+            benchmarks[b].run();
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,121 @@
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include "bst.h"
+#include "avlbst.h"
+#include "ingest.h"
+
+using namespace std;
+
+// Loads key/value records from a file (or stdin) into a tree and
+// reports throughput and memory.
+//
+//   bst-ingest [-t bst|avl] [-f tsv|bin] [-b batch] [-q depth] [-r bufKB] [-p threads] [file|-]
+//
+// -p runs the pipelined ingestAsync() with that many parse threads.
+
+static void usage(const char* prog)
+{
+    cerr << "usage: " << prog << " [-t bst|avl] [-f tsv|bin] [-b batch] [-q depth] [-r bufKB] [-p threads] [file|-]" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    ios::sync_with_stdio(false);
+
+    IngestOptions opts;
+    string treeType = "avl";
+    string path = "-";
+    bool pipelined = false;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if(arg == "-t" && i + 1 < argc)
+        {
+            treeType = argv[++i];
+        }
+        else if(arg == "-f" && i + 1 < argc)
+        {
+            string fmt = argv[++i];
+            if(fmt == "tsv")
+            {
+                opts.format = INGEST_TSV;
+            }
+            else if(fmt == "bin")
+            {
+                opts.format = INGEST_BINARY;
+            }
+            else
+            {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if(arg == "-b" && i + 1 < argc)
+        {
+            opts.batchSize = strtoul(argv[++i], NULL, 10);
+        }
+        else if(arg == "-q" && i + 1 < argc)
+        {
+            opts.queueDepth = strtoul(argv[++i], NULL, 10);
+        }
+        else if(arg == "-r" && i + 1 < argc)
+        {
+            opts.readBufferSize = strtoul(argv[++i], NULL, 10) * 1024;
+        }
+        else if(arg == "-p" && i + 1 < argc)
+        {
+            opts.parseThreads = (unsigned)strtoul(argv[++i], NULL, 10);
+            pipelined = true;
+        }
+        else if(arg == "-h" || (arg.size() > 1 && arg[0] == '-'))
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        else
+        {
+            path = arg;
+        }
+    }
+
+    if(treeType != "bst" && treeType != "avl")
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    ifstream file;
+    istream* in = &cin;
+    if(path != "-")
+    {
+        file.open(path.c_str(), ios::in | ios::binary);
+        if(!file)
+        {
+            cerr << "cannot open " << path << endl;
+            return 1;
+        }
+        in = &file;
+    }
+
+    BinarySearchTree<string, string>* tree;
+    if(treeType == "bst")
+    {
+        tree = new BinarySearchTree<string, string>();
+    }
+    else
+    {
+        tree = new AVLTree<string, string>();
+    }
+
+    IngestStats stats = pipelined ? ingestAsync(*in, *tree, opts).get() : ingest(*in, *tree, opts);
+    cout << "tree:        " << treeType << "\n";
+    stats.print(cout);
+    tree->memoryReport().print(cout);
+
+    delete tree;
+    return 0;
+}
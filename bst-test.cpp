@@ -1,7 +1,16 @@
 #include <iostream>
 #include <map>
+#include <thread>
 #include "bst.h"
 #include "avlbst.h"
+#include "rbtree.h"
+#include "splaybst.h"
+#include "scapegoatbst.h"
+#include "string-keys.h"
+#include "compact-avl.h"
+#include "parentless-avl.h"
+#include "mapped-avl.h"
+#include "shared-avl.h"
 
 using namespace std;
 
@@ -44,5 +53,296 @@ int main(int argc, char *argv[])
     cout << "Erasing b" << endl;
     at.remove('b');
 
+    // Red-black tree
+    RedBlackTree<int,int> rt;
+    for(int i = 0; i < 32; ++i) {
+        rt.insert(std::make_pair(i, i * i));
+    }
+    for(int i = 0; i < 32; i += 3) {
+        rt.remove(i);
+    }
+    cout << "\nRedBlackTree contents:";
+    for(RedBlackTree<int,int>::iterator it = rt.begin(); it != rt.end(); ++it) {
+        cout << " " << it->first;
+    }
+    cout << endl << "RedBlackTree valid " << rt.isBalanced() << ", height " << rt.height() << endl;
+
+    // Auto-rebuild keeps a plain BST shallow under sorted inserts
+    BinarySearchTree<int,int> sorted;
+    sorted.enableAutoRebuild(2.0);
+    for(int i = 0; i < 1000; ++i) {
+        sorted.insert(std::make_pair(i, i));
+    }
+    cout << "\nAuto-rebuild BST size " << sorted.size() << ", height " << sorted.height() << endl;
+
+    // Splay tree: a hit moves the key to the root
+    SplayTree<int,int> st;
+    for(int i = 0; i < 32; ++i) {
+        st.insert(std::make_pair(i, i));
+    }
+    st.remove(10);
+    cout << "\nSplayTree height " << st.height();
+    st.find(0);
+    cout << ", after find(0) " << st.height() << ", find(10) " << (st.find(10) != st.end()) << endl;
+    st.setSemiSplay(true);
+    st.find(31);
+    cout << "SplayTree size " << st.size() << ", height after semi-splay " << st.height() << endl;
+    const SplayTree<int,int>& frozen = st;
+    int before = st.height();
+    cout << "SplayTree const find(0) " << (frozen.find(0) != frozen.end()) << ", height unchanged "
+         << (st.height() == before) << endl;
+    SplayTree<int,int> chain;
+    for(int i = 0; i < 32; ++i) {
+        chain.insert(std::make_pair(i, i));
+    }
+    BinarySearchTree<int,int>& asTree = chain;
+    cout << "SplayTree through a BinarySearchTree&: height " << asTree.height();
+    asTree.find(0);
+    cout << ", after find(0) " << asTree.height();
+    asTree[31] += 1;
+    cout << ", after [31] " << asTree.height() << endl;
+
+    // Scapegoat tree: sorted inserts stay balanced with plain nodes
+    ScapegoatTree<int,int> sg;
+    for(int i = 0; i < 1000; ++i) {
+        sg.insert(std::make_pair(i, i));
+    }
+    for(int i = 0; i < 1000; i += 2) {
+        sg.remove(i);
+    }
+    cout << "ScapegoatTree size " << sg.size() << ", height " << sg.height() << ", node bytes "
+         << sg.memoryReport().node.totalBytes() << endl;
+
+    // Range erases in the middle rejoin both sides without growing the tree
+    ScapegoatTree<int,int> cuts;
+    for(int i = 0; i < 10000; ++i) {
+        cuts.insert(std::make_pair(i, i));
+    }
+    for(int lo = 100; lo + 5 < 10000; lo += 50) {
+        cuts.eraseRange(lo, lo + 5);
+    }
+    cout << "ScapegoatTree after range erases size " << cuts.size() << ", height " << cuts.height() << endl;
+
+    // AVL(2): subtree heights may differ by up to two
+    AVLTree<int,int,2> relaxed;
+    for(int i = 0; i < 1000; ++i) {
+        relaxed.insert(std::make_pair(i, i));
+    }
+    for(int i = 0; i < 1000; i += 3) {
+        relaxed.remove(i);
+    }
+    cout << "AVL(2) size " << relaxed.size() << ", height " << relaxed.height() << ", valid "
+         << relaxed.isBalanced() << endl;
+
+    // Hinted inserts and finds start from an iterator instead of the root
+    AVLTree<int,int> timeline;
+    AVLTree<int,int>::iterator hint = timeline.end();
+    for(int i = 0; i < 100; ++i) {
+        hint = timeline.insert(hint, std::make_pair(i * 10, i));
+    }
+    hint = timeline.insert(timeline.find(500), std::make_pair(505, -1));
+    cout << "Hinted AVL size " << timeline.size() << ", balanced " << timeline.isBalanced() << ", after 505: "
+         << (++hint)->first << ", find(hint, 520) " << timeline.find(hint, 520)->second << ", find(hint, 521) "
+         << (timeline.find(hint, 521) != timeline.end()) << endl;
+
+    // Range erase detaches whole subtrees and rejoins the two sides
+    size_t cut = timeline.eraseRange(100, 800);
+    AVLTree<int,int>::iterator rest = timeline.erase(timeline.begin(), timeline.find(50));
+    cout << "Range erase removed " << cut << ", then up to " << rest->first << ": size " << timeline.size()
+         << ", balanced " << timeline.isBalanced() << ", first keys " << timeline.begin()->first << " "
+         << (++timeline.begin())->first << " " << (++(++timeline.begin()))->first << endl;
+
+    // Copies keep the exact shape and balances
+    AVLTree<int,int> whatIf(timeline);
+    whatIf.remove(50);
+    AVLTree<int,int> parallel;
+    timeline.enableParallelCopy(2);
+    parallel = timeline;
+    cout << "Copied AVL size " << whatIf.size() << " (original " << timeline.size() << "), height "
+         << whatIf.height() << ", balanced " << whatIf.isBalanced() << "; parallel copy size " << parallel.size()
+         << ", height " << parallel.height() << ", balanced " << parallel.isBalanced() << endl;
+    RedBlackTree<int,int> otherKind;
+    BinarySearchTree<int,int>& asBase = parallel;
+    try {
+        asBase = otherKind;
+    } catch(const std::invalid_argument& e) {
+        cout << "Assigning a red-black tree to an AVL tree: " << e.what() << ", size still " << parallel.size()
+             << endl;
+    }
+
+    // Merging relinks both trees' nodes into one balanced tree
+    AVLTree<int,int> evens;
+    AVLTree<int,int> odds;
+    for(int i = 0; i < 20; ++i) {
+        evens.insert(std::make_pair(i * 2, i));
+        odds.insert(std::make_pair(i * 3 + 1, -i));
+    }
+    evens.merge(odds, MERGE_KEEP_EXISTING);
+    cout << "Merged AVL size " << evens.size() << " (other now " << odds.size() << "), height " << evens.height()
+         << ", balanced " << evens.isBalanced() << ", [4] " << evens[4] << ", [7] " << evens[7] << endl;
+
+    // Lazy deletion: removes leave tombstones until compact()
+    AVLTree<int,int> lazy;
+    lazy.enableLazyDelete(0.5);
+    for(int i = 0; i < 16; ++i) {
+        lazy.insert(std::make_pair(i, i));
+    }
+    for(int i = 0; i < 16; i += 3) {
+        lazy.remove(i);
+    }
+    lazy.insert(std::make_pair(3, 30));
+    cout << "Lazy AVL size " << lazy.size() << ", tombstones " << lazy.tombstones() << ", find(6) "
+         << (lazy.find(6) != lazy.end()) << ", contents:";
+    for(AVLTree<int,int>::iterator it = lazy.begin(); it != lazy.end(); ++it) {
+        cout << " " << it->first;
+    }
+    lazy.compact();
+    cout << endl << "After compact: tombstones " << lazy.tombstones() << ", balanced " << lazy.isBalanced() << endl;
+
+    // String keys stored in an arena, looked up through views
+    StringKeyArena arena;
+    AVLTree<ArenaKey,int> urls;
+    const char* paths[] = { "https://example.com/b", "https://example.com/a/2", "https://example.com/a/10",
+                            "https://example.com/a" };
+    for(int i = 0; i < 4; ++i) {
+        urls.insert(std::make_pair(arena.store(paths[i]), i));
+    }
+    std::string probe = "https://example.com/a/2";
+    cout << "ArenaKey find " << probe << " -> " << urls[ArenaKey(probe)] << ", in order:";
+    for(AVLTree<ArenaKey,int>::iterator it = urls.begin(); it != urls.end(); ++it) {
+        cout << " " << it->first;
+    }
+    cout << endl << "arena bytes used " << arena.bytesUsed() << endl;
+
+    // Compact AVL: nodes in one array, 32-bit links, packed balance
+    CompactAVLTree<int,int> compact;
+    for(int i = 0; i < 1000; ++i) {
+        compact.insert(std::make_pair(i, i));
+    }
+    for(int i = 0; i < 1000; i += 2) {
+        compact.remove(i);
+    }
+    compact[7] = 70;
+    cout << "CompactAVLTree size " << compact.size() << ", height " << compact.height() << ", balanced "
+         << compact.isBalanced() << ", node bytes " << compact.memoryReport().node.totalBytes() << ", first:";
+    CompactAVLTree<int,int>::iterator cit = compact.begin();
+    for(int i = 0; i < 4; ++i, ++cit) {
+        cout << " " << cit->first << "=" << cit->second;
+    }
+    cout << endl;
+
+    // Parentless AVL: path stacks instead of parent pointers
+    ParentlessAVLTree<int,int> parentless;
+    for(int i = 0; i < 1000; ++i) {
+        parentless.insert(std::make_pair(i, i));
+    }
+    for(int i = 0; i < 1000; i += 2) {
+        parentless.remove(i);
+    }
+    cout << "ParentlessAVLTree size " << parentless.size() << ", height " << parentless.height() << ", balanced "
+         << parentless.isBalanced() << ", node bytes " << parentless.memoryReport().node.totalBytes()
+         << ", from 995:";
+    for(ParentlessAVLTree<int,int>::iterator it = parentless.find(995); it != parentless.end(); ++it) {
+        cout << " " << it->first;
+    }
+    cout << endl;
+
+    // Mapped AVL: the tree lives in a file and survives reopening
+    std::string treeFile = "/tmp/bst-test-" + std::to_string(getpid()) + ".tree";
+    {
+        MappedAVLTree<int,int> mapped(treeFile, 16);
+        for(int i = 0; i < 1000; ++i) {
+            mapped.insert(std::make_pair(i, i * i));
+        }
+        for(int i = 0; i < 1000; i += 4) {
+            mapped.remove(i);
+        }
+        mapped.checkpoint();
+    }
+    {
+        MappedAVLTree<int,int> mapped(treeFile);
+        cout << "MappedAVLTree reopened size " << mapped.size() << ", balanced " << mapped.isBalanced()
+             << ", [30] " << mapped[30] << ", find(32) " << (mapped.find(32) != mapped.end()) << endl;
+    }
+    unlink(treeFile.c_str());
+
+    // Shared AVL: one writer, readers map the same segment
+    std::string segment = "/bst-test-" + std::to_string(getpid());
+    {
+        SharedAVLTree<int,int> writer(segment, 16);
+        SharedAVLReader<int,int> reader(segment);
+        for(int i = 0; i < 100; ++i) {
+            writer.insert(std::make_pair(i, -i));
+        }
+        writer.remove(50);
+        int value = 0;
+        bool found = reader.find(42, value);
+        cout << "SharedAVLTree version " << reader.version() << ", reader size " << reader.size() << ", find(42) "
+             << found << " -> " << value << ", contains(50) " << reader.contains(50) << endl;
+    }
+    SharedAVLTree<int,int>::unlink(segment);
+
+    // Memory accounting
+    for(int i = 0; i < 20; ++i) {
+        at.insert(std::make_pair((char)('c' + i), i));
+    }
+    for(int i = 0; i < 5; ++i) {
+        at.remove((char)('c' + i));
+    }
+    cout << "\nAVLTree height " << at.height() << ", balanced " << at.isBalanced() << endl;
+    cout << "\nAVLTree shape:" << endl;
+    at.shapeReport().print(cout);
+    cout << "\nAVLTree memory (size " << at.size() << "):" << endl;
+    at.memoryReport().print(cout);
+
+    // Latency histograms
+    BinarySearchTree<int,int> lt;
+    lt.enableLatencyTracking();
+    for(int i = 0; i < 100; ++i) {
+        lt.insert(std::make_pair((i * 37) % 100, i));
+    }
+    int visited = 0;
+    for(BinarySearchTree<int,int>::iterator it = lt.begin(); it != lt.end(); ++it) {
+        visited++;
+    }
+    lt.find(42);
+    lt.remove(42);
+    // Another thread's lookups land in its own histograms
+    const BinarySearchTree<int,int>& shared = lt;
+    std::thread lookups([&shared]() {
+        for(int i = 0; i < 10; ++i) {
+            shared.find(i);
+        }
+    });
+    lookups.join();
+    TreeLatency samples = lt.latency();
+    cout << "\nLatency samples: insert " << samples.insert.count()
+         << " remove " << samples.remove.count()
+         << " find " << samples.find.count()
+         << " advance " << samples.advance.count()
+         << " (visited " << visited << ")" << endl;
+
+    // DOT / JSON export
+    AVLTree<int,string> et;
+    for(int i = 1; i <= 7; ++i) {
+        et.insert(std::make_pair(i, string(1, (char)('a' + i - 1))));
+    }
+    cout << "\nDOT export:" << endl;
+    et.exportTree(cout, EXPORT_DOT);
+    ExportOptions shallow;
+    shallow.maxDepth = 2;
+    cout << "JSON export (2 levels):" << endl;
+    et.exportTree(cout, EXPORT_JSON, shallow);
+    // Tombstones stay in the export, marked, but not in the size
+    et.enableLazyDelete(0.9);
+    et.remove(2);
+    cout << "JSON export after lazy remove(2), subtree at 2 " << et.exportSubtree(2, cout, EXPORT_JSON) << ":" << endl;
+    et.exportTree(cout, EXPORT_JSON, shallow);
+
+#ifdef BST_STATS
+    cout << "\nTree operation counters:" << endl;
+    treeStatsSnapshot().print(cout);
+#endif
+
     return 0;
 }
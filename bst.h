@@ -1,10 +1,23 @@
 #ifndef BST_H
 #define BST_H
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <exception>
+#include <cmath>
+#include <cstdint>
 #include <cstdlib>
+#include <stdexcept>
+#include <thread>
+#include <typeinfo>
 #include <utility>
+#include <vector>
+#include "tree-memory.h"
+#include "tree-stats.h"
+#include "latency-histogram.h"
+#include "shape-report.h"
+#include "key-search.h"
 
 /**
  * A templated class for a Node in a search tree.
@@ -29,6 +42,8 @@ public:
     virtual Node<Key, Value>* getParent() const;
     virtual Node<Key, Value>* getLeft() const;
     virtual Node<Key, Value>* getRight() const;
+    virtual bool isTombstone() const;
+    virtual Node<Key, Value>* clone() const;
 
     void setParent(Node<Key, Value>* parent);
     void setLeft(Node<Key, Value>* left);
@@ -36,10 +51,19 @@ public:
     void setValue(const Value &value);
 
 protected:
+    // Nodes are 8-byte aligned, so the low 3 bits of each link are free.
+    // Subclasses keep their per-node metadata (AVL balance, red-black
+    // color) there instead of in a padded field of their own: 9 tag bits,
+    // bits 0-2 in the parent link, 3-5 in the left and 6-8 in the right.
+    static const uintptr_t TAG_MASK = 7;
+    static const unsigned TAG_BITS = 9;
+    unsigned getTag() const;
+    void setTag(unsigned tag);
+
     std::pair<const Key, Value> item_;
-    Node<Key, Value>* parent_;
-    Node<Key, Value>* left_;
-    Node<Key, Value>* right_;
+    uintptr_t parent_;   // links with tag bits, see above
+    uintptr_t left_;
+    uintptr_t right_;
 };
 
 /*
@@ -54,11 +78,11 @@ protected:
 template<typename Key, typename Value>
 Node<Key, Value>::Node(const Key& key, const Value& value, Node<Key, Value>* parent) :
     item_(key, value),
-    parent_(parent),
-    left_(NULL),
-    right_(NULL)
+    parent_(reinterpret_cast<uintptr_t>(parent)),
+    left_(0),
+    right_(0)
 {   
-
+    static_assert(alignof(Node<Key, Value>) > TAG_MASK, "tag bits need 8-byte aligned nodes");
 }
 
 /**
@@ -123,7 +147,7 @@ Value& Node<Key, Value>::getValue()
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getParent() const
 {
-    return parent_;
+    return reinterpret_cast<Node<Key, Value>*>(parent_ & ~TAG_MASK);
 }
 
 /**
@@ -132,7 +156,7 @@ Node<Key, Value>* Node<Key, Value>::getParent() const
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getLeft() const
 {
-    return left_;
+    return reinterpret_cast<Node<Key, Value>*>(left_ & ~TAG_MASK);
 }
 
 /**
@@ -141,7 +165,30 @@ Node<Key, Value>* Node<Key, Value>::getLeft() const
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getRight() const
 {
-    return right_;
+    return reinterpret_cast<Node<Key, Value>*>(right_ & ~TAG_MASK);
+}
+
+/**
+* Whether the node is logically deleted. Plain nodes never are; trees
+* with lazy deletion override this.
+*/
+template<typename Key, typename Value>
+bool Node<Key, Value>::isTombstone() const
+{
+    return false;
+}
+
+/**
+* An unlinked copy of this node: the item and the tag bits, so subclass
+* metadata comes along. Subclasses override it to allocate their own
+* node type.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* Node<Key, Value>::clone() const
+{
+    Node<Key, Value>* copy = new Node<Key, Value>(item_.first, item_.second, NULL);
+    copy->setTag(getTag());
+    return copy;
 }
 
 /**
@@ -150,7 +197,7 @@ Node<Key, Value>* Node<Key, Value>::getRight() const
 template<typename Key, typename Value>
 void Node<Key, Value>::setParent(Node<Key, Value>* parent)
 {
-    parent_ = parent;
+    parent_ = reinterpret_cast<uintptr_t>(parent) | (parent_ & TAG_MASK);
 }
 
 /**
@@ -159,7 +206,7 @@ void Node<Key, Value>::setParent(Node<Key, Value>* parent)
 template<typename Key, typename Value>
 void Node<Key, Value>::setLeft(Node<Key, Value>* left)
 {
-    left_ = left;
+    left_ = reinterpret_cast<uintptr_t>(left) | (left_ & TAG_MASK);
 }
 
 /**
@@ -168,7 +215,27 @@ void Node<Key, Value>::setLeft(Node<Key, Value>* left)
 template<typename Key, typename Value>
 void Node<Key, Value>::setRight(Node<Key, Value>* right)
 {
-    right_ = right;
+    right_ = reinterpret_cast<uintptr_t>(right) | (right_ & TAG_MASK);
+}
+
+/**
+* The TAG_BITS bits of metadata kept in the low bits of the links.
+*/
+template<typename Key, typename Value>
+unsigned Node<Key, Value>::getTag() const
+{
+    return (unsigned)((parent_ & TAG_MASK) | (left_ & TAG_MASK) << 3 | (right_ & TAG_MASK) << 6);
+}
+
+/**
+* Replaces the tag bits, leaving the links alone.
+*/
+template<typename Key, typename Value>
+void Node<Key, Value>::setTag(unsigned tag)
+{
+    parent_ = (parent_ & ~TAG_MASK) | (tag & TAG_MASK);
+    left_ = (left_ & ~TAG_MASK) | ((tag >> 3) & TAG_MASK);
+    right_ = (right_ & ~TAG_MASK) | ((tag >> 6) & TAG_MASK);
 }
 
 /**
@@ -186,6 +253,50 @@ void Node<Key, Value>::setValue(const Value& value)
   ---------------------------------------
 */
 
+/**
+* Child accessor used to run the generic shape analysis (shape-report.h)
+* over Node trees.
+*/
+template<typename Key, typename Value>
+struct NodeChildren {
+    void operator()(Node<Key, Value>* node, Node<Key, Value>*& left, Node<Key, Value>*& right) const
+    {
+        left = node->getLeft();
+        right = node->getRight();
+    }
+};
+
+/**
+* Result of BinarySearchTree::search(): the node holding a key, or else
+* where a node for it would be linked.
+*/
+template<typename Key, typename Value>
+struct NodeSearch {
+    Node<Key, Value>* node;    // node holding the key, or nullptr
+    Node<Key, Value>* parent;  // node's parent, or the parent for a new node
+    bool left;                 // whether that is the parent's left child
+    int depth;                 // edges from the root to node (or the new node),
+                               // -1 when the search started from a finger
+};
+
+/**
+* Output formats and limits for BinarySearchTree::exportTree()
+* (implemented in export_bst.h).
+*/
+enum TreeExportFormat { EXPORT_DOT, EXPORT_JSON };
+
+struct ExportOptions {
+    int maxDepth;     // deepest level to write (root is 1); -1 for no limit
+    size_t maxNodes;  // stop writing nodes after this many; 0 for no limit
+
+    ExportOptions() : maxDepth(-1), maxNodes(0) {}
+};
+
+/**
+* Which value BinarySearchTree::merge() keeps for a key in both trees.
+*/
+enum MergePolicy { MERGE_OVERWRITE, MERGE_KEEP_EXISTING };
+
 /**
 * A templated unbalanced binary search tree.
 */
@@ -194,13 +305,33 @@ class BinarySearchTree
 {
 public:
     BinarySearchTree(); //TODO
+    BinarySearchTree(const BinarySearchTree& other);
+    BinarySearchTree& operator=(const BinarySearchTree& other);
     virtual ~BinarySearchTree(); //TODO
     virtual void insert(const std::pair<const Key, Value>& keyValuePair); //TODO
     virtual void remove(const Key& key); //TODO
     void clear(); //TODO
-    bool isBalanced() const; //TODO
+    virtual bool isBalanced() const; //TODO
+    int height() const;
+    ShapeReport shapeReport(unsigned threads = 1) const;
     void print() const;
+    void exportTree(std::ostream& out, TreeExportFormat format,
+                    const ExportOptions& options = ExportOptions()) const;
+    bool exportSubtree(const Key& key, std::ostream& out, TreeExportFormat format,
+                       const ExportOptions& options = ExportOptions()) const;
     bool empty() const;
+    size_t size() const;
+    MemoryReport memoryReport() const;
+    void enableLatencyTracking();
+    void disableLatencyTracking();
+    TreeLatency latency() const;
+    void enableAutoRebuild(double factor = 2.0);
+    void disableAutoRebuild();
+    void enableParallelCopy(unsigned threads);
+    void disableParallelCopy();
+    void merge(BinarySearchTree& other, MergePolicy policy = MERGE_OVERWRITE);
+    template<typename Combine>
+    void merge(BinarySearchTree& other, Combine combine);
 
     template<typename PPKey, typename PPValue>
     friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue> & tree);
@@ -223,20 +354,55 @@ public:
 
     protected:
         friend class BinarySearchTree<Key, Value>;
-        iterator(Node<Key,Value>* ptr);
+        iterator(Node<Key,Value>* ptr, TreeLatencyRecorder* latency = NULL);
         Node<Key, Value> *current_;
+        TreeLatencyRecorder* latency_;
     };
 
 public:
     iterator begin() const;
     iterator end() const;
     iterator find(const Key& key) const;
+    iterator find(const Key& key);
+    iterator insert(const iterator& hint, const std::pair<const Key, Value>& keyValuePair);
+    iterator find(const iterator& hint, const Key& key) const;
+    iterator find(const iterator& hint, const Key& key);
+    iterator erase(const iterator& first, const iterator& last);
+    size_t eraseRange(const Key& low, const Key& high);
     Value& operator[](const Key& key);
     Value const & operator[](const Key& key) const;
 
 protected:
     // Mandatory helper functions
     Node<Key, Value>* internalFind(const Key& k) const; // TODO
+    NodeSearch<Key, Value> search(const Key& k) const;
+    NodeSearch<Key, Value> searchFrom(Node<Key, Value>* finger, const Key& k) const;
+    NodeSearch<Key, Value> descend(Node<Key, Value>* top, const Key& k, int depth) const;
+    Node<Key, Value>* rightmost() const;
+    static int nodeDepth(Node<Key, Value>* node);
+    virtual Node<Key, Value>* insertAt(const NodeSearch<Key, Value>& found,
+                                       const std::pair<const Key, Value>& keyValuePair);
+    virtual void accessed(Node<Key, Value>* node);
+
+    // Range erase: split at both bounds, free the middle, join the rest
+    struct SplitStep {
+        Node<Key, Value>* node;
+        int height;   // of node's subtree, when the tree tracks heights
+        bool toLess;  // whether node goes to the smaller side
+    };
+    virtual size_t eraseKeys(const Key* low, const Key* high);
+    void splitPath(const std::vector<SplitStep>& path, Node<Key, Value>*& less, int& lessHeight,
+                   Node<Key, Value>*& rest, int& restHeight);
+    void splitAt(Node<Key, Value>* root, int height, const Key& key, Node<Key, Value>*& less, int& lessHeight,
+                 Node<Key, Value>*& rest, int& restHeight);
+    Node<Key, Value>* joinAll(Node<Key, Value>* less, int lessHeight, Node<Key, Value>* rest, int restHeight);
+    virtual Node<Key, Value>* joinTrees(Node<Key, Value>* left, int leftHeight, Node<Key, Value>* mid,
+                                        Node<Key, Value>* right, int rightHeight, int& height);
+    virtual int splitHeight(Node<Key, Value>* root) const;
+    virtual int childHeight(Node<Key, Value>* node, int height, bool left) const;
+    size_t freeSubtree(Node<Key, Value>* root);
+    Node<Key, Value>* lowerBound(const Key& key) const;
+    Node<Key, Value>* findLive(const Key& k) const;
     Node<Key, Value> *getSmallestNode() const;  // TODO
     static Node<Key, Value>* predecessor(Node<Key, Value>* current); // TODO
     static Node<Key, Value>* successor(Node<Key, Value>* current);
@@ -245,17 +411,45 @@ protected:
 
     // Provided helper functions
     virtual void printRoot (Node<Key, Value> *r) const;
+    void exportRoot(Node<Key, Value>* r, std::ostream& out, TreeExportFormat format,
+                    const ExportOptions& options) const;
     virtual void nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2) ;
 
     // Add helper functions here
     void clearHelper(Node<Key, Value>* root);
     int depth(Node<Key, Value>*node) const;
-    bool balancehelper(Node<Key,Value>* root) const;
+    int balancehelper(Node<Key,Value>* root) const;
+    virtual int subtreeHeight(Node<Key, Value>* node) const;
+    void spliceOut(Node<Key, Value>* node);
+    void rotateRight(Node<Key, Value>* pivot);
+    void rotateLeft(Node<Key, Value>* pivot);
+    void flattenSubtree(Node<Key, Value>* root, std::vector<Node<Key, Value>*>& out) const;
+    Node<Key, Value>* linkBalanced(const std::vector<Node<Key, Value>*>& nodes, Node<Key, Value>* parent);
+    int linkBalancedRange(const std::vector<Node<Key, Value>*>& nodes, size_t lo, size_t hi,
+                          Node<Key, Value>* parent, Node<Key, Value>*& subtree);
+    Node<Key, Value>* rebuildSubtree(Node<Key, Value>* root);
+    bool rebuildScapegoat(Node<Key, Value>* inserted, double alpha);
+    static size_t subtreeSize(Node<Key, Value>* root);
+    virtual void rebuiltNode(Node<Key, Value>* node, int leftHeight, int rightHeight);
+    virtual void rebuiltTree();
+    void noteNodeAdded(Node<Key, Value>* node);
+    void noteNodeRemoved(Node<Key, Value>* node);
+    iterator makeIterator(Node<Key, Value>* node) const;
+    static Node<Key, Value>* iteratorNode(const iterator& it);
+    virtual NodeLayout nodeLayout() const;
+    void copyTree(const BinarySearchTree& other);
+    static void copyChildren(const Node<Key, Value>* src, Node<Key, Value>* dst);
 
 
 protected:
     Node<Key, Value>* root_;
-    // You should not need other data members
+    size_t nodeCount_;
+    size_t peakNodeCount_;
+    size_t tombstoneCount_;   // nodes still linked but logically deleted
+    TreeLatencyRecorder* latency_;
+    double autoRebuildFactor_;  // c in the c*log2(n) depth limit; 0 when off
+    mutable Node<Key, Value>* rightmost_;  // largest node, or NULL when not known
+    unsigned copyThreads_;   // threads copies of this tree use; 1 when serial
 };
 
 /*
@@ -268,12 +462,16 @@ Begin implementations for the BinarySearchTree::iterator class.
 * Explicit constructor that initializes an iterator with a given node pointer.
 */
 template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator(Node<Key,Value> *ptr)
+BinarySearchTree<Key, Value>::iterator::iterator(Node<Key,Value> *ptr, TreeLatencyRecorder* latency)
 {
     // TODO
     //If the user gives us somewhere specific to point we set
     //the current iterator pointer to that specific location
     current_ = ptr;
+
+    //Where to record the cost of operator++ (NULL if not tracked); the
+    //advancing thread's own histogram is looked up on each step
+    latency_ = latency;
 }
 
 /**
@@ -286,6 +484,7 @@ BinarySearchTree<Key, Value>::iterator::iterator()
     //If an iterator is declared without initialization
     //set to point nowhere NULL
     current_ = nullptr;
+    latency_ = nullptr;
 }
 
 /**
@@ -350,7 +549,11 @@ typename BinarySearchTree<Key, Value>::iterator&
 BinarySearchTree<Key, Value>::iterator::operator++()
 {
     // TODO
-    current_ = successor(current_);
+    LatencyTimer timer(latency_ != NULL ? &latency_->local().advance : NULL);
+    do
+    {
+        current_ = successor(current_);
+    } while(current_ != NULL && current_->isTombstone());
     return *this;
 }
 
@@ -375,611 +578,1781 @@ BinarySearchTree<Key, Value>::BinarySearchTree()
 {
     // TODO
     root_ = nullptr;
+    nodeCount_ = 0;
+    peakNodeCount_ = 0;
+    tombstoneCount_ = 0;
+    latency_ = nullptr;
+    autoRebuildFactor_ = 0;
+    rightmost_ = nullptr;
+    copyThreads_ = 1;
 }
 
-template<typename Key, typename Value>
-BinarySearchTree<Key, Value>::~BinarySearchTree()
+/**
+* Copies other node for node, so the copy has the same shape and node
+* metadata (AVL balances, colors, tombstones) and needs no rebalancing:
+* O(n) instead of n inserts. Settings come along; latency histograms
+* start empty.
+*/
+template<class Key, class Value>
+BinarySearchTree<Key, Value>::BinarySearchTree(const BinarySearchTree& other)
 {
-    // TODO
-    //Call the clear function to 
-    //Make the tree back to its empty state
-    clear();
+    root_ = nullptr;
+    latency_ = other.latency_ != nullptr ? new TreeLatencyRecorder() : nullptr;
+    autoRebuildFactor_ = other.autoRebuildFactor_;
+    copyThreads_ = other.copyThreads_;
+    copyTree(other);
 }
 
 /**
- * Returns true if tree is empty
+* Replaces the contents with a structural copy of other; see the copy
+* constructor. Both must be the same kind of tree, since the cloned
+* nodes keep other's node type; assigning through base class references
+* to a different tree throws std::invalid_argument and leaves this tree
+* unchanged.
 */
 template<class Key, class Value>
-bool BinarySearchTree<Key, Value>::empty() const
+BinarySearchTree<Key, Value>& BinarySearchTree<Key, Value>::operator=(const BinarySearchTree& other)
 {
-    return root_ == NULL;
+    if(this == &other)
+    {
+        return *this;
+    }
+    if(typeid(*this) != typeid(other))
+    {
+        throw std::invalid_argument("operator= needs two trees of the same type");
+    }
+    clear();
+    if(other.latency_ == nullptr)
+    {
+        delete latency_;
+        latency_ = nullptr;
+    }
+    else if(latency_ == nullptr)
+    {
+        latency_ = new TreeLatencyRecorder();
+    }
+    autoRebuildFactor_ = other.autoRebuildFactor_;
+    copyThreads_ = other.copyThreads_;
+    copyTree(other);
+    return *this;
 }
 
 template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::print() const
+BinarySearchTree<Key, Value>::~BinarySearchTree()
 {
-    printRoot(root_);
-    std::cout << "\n";
+    // TODO
+    //Call the clear function to 
+    //Make the tree back to its empty state
+    clear();
+    delete latency_;
 }
 
 /**
-* Returns an iterator to the "smallest" item in the tree
+ * Returns true if tree is empty
 */
 template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::begin() const
+bool BinarySearchTree<Key, Value>::empty() const
 {
-    BinarySearchTree<Key, Value>::iterator begin(getSmallestNode());
-    return begin;
+    return size() == 0;
 }
 
 /**
-* Returns an iterator whose value means INVALID
+ * Returns the number of nodes in the tree
 */
 template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::end() const
+size_t BinarySearchTree<Key, Value>::size() const
 {
-    BinarySearchTree<Key, Value>::iterator end(NULL);
-    return end;
+    return nodeCount_ - tombstoneCount_;
 }
 
 /**
-* Returns an iterator to the item with the given key, k
-* or the end iterator if k does not exist in the tree
+ * Returns the per-node byte breakdown together with the live and peak
+ * node counts. The counts are kept up to date on every insert/remove,
+ * so this is O(1).
 */
 template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::find(const Key & k) const
+MemoryReport BinarySearchTree<Key, Value>::memoryReport() const
 {
-    Node<Key, Value> *curr = internalFind(k);
-    BinarySearchTree<Key, Value>::iterator it(curr);
-    return it;
+    MemoryReport report;
+    report.node = nodeLayout();
+    report.liveNodes = nodeCount_;
+    report.peakNodes = peakNodeCount_;
+    return report;
 }
 
 /**
- * @precondition The key exists in the map
- * Returns the value associated with the key
- */
-template<class Key, class Value>
-Value& BinarySearchTree<Key, Value>::operator[](const Key& key)
-{
-    Node<Key, Value> *curr = internalFind(key);
-    if(curr == NULL) throw std::out_of_range("Invalid key");
-    return curr->getValue();
-}
+ * Layout of the nodes this tree allocates. Trees with their own node
+ * type override this.
+*/
 template<class Key, class Value>
-Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
+NodeLayout BinarySearchTree<Key, Value>::nodeLayout() const
 {
-    Node<Key, Value> *curr = internalFind(key);
-    if(curr == NULL) throw std::out_of_range("Invalid key");
-    return curr->getValue();
+    return describeNode<Node<Key, Value>, Key, Value>(3, 0);
 }
 
 /**
-* An insert method to insert into a Binary Search Tree.
-* The tree will not remain balanced when inserting.
-* Recall: If key is already in the tree, you should 
-* overwrite the current value with the updated value.
+ * Clones other's nodes into this (empty) tree; operator= has checked
+ * that both trees use the same node type. With parallel copy on,
+ * the top levels are cloned breadth first until there are a few
+ * subtrees per thread, as in analyzeShape(), and the threads then fill
+ * in the subtrees below them; each only links nodes under its own.
 */
 template<class Key, class Value>
-void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &keyValuePair)
+void BinarySearchTree<Key, Value>::copyTree(const BinarySearchTree& other)
 {
-    // TODO
-    //Check to see if the node already in the tree
-    //If so just update the value of the node
-    Node<Key, Value>* found = internalFind(keyValuePair.first);
-    if(found != nullptr)
+    nodeCount_ = other.nodeCount_;
+    peakNodeCount_ = other.nodeCount_;
+    tombstoneCount_ = other.tombstoneCount_;
+    rightmost_ = nullptr;
+    if(other.root_ == nullptr)
     {
-        found->setValue(keyValuePair.second); //update value if already in tree
         return;
     }
-    //This holds the dynamic node to get updated as we find where
-    //it needs to be inserted
-    Node<Key, Value>* newNode = new Node<Key,Value> (keyValuePair.first, keyValuePair.second, nullptr);
-    if(root_ == nullptr)
+    root_ = other.root_->clone();
+    if(copyThreads_ <= 1)
     {
-        root_ = newNode;
+        copyChildren(other.root_, root_);
         return;
     }
 
-    //This will hold a copy of the root so we can traverse
-    Node<Key, Value>* current = root_;
-
-    //This will be the node where we find to insert the new item 
-    Node<Key, Value>* node = current;
-
-    //While we can traverse
-    while(current != nullptr)
+    typedef std::pair<const Node<Key, Value>*, Node<Key, Value>*> CopyPair;
+    const size_t target = (size_t)copyThreads_ * 8;
+    std::vector<CopyPair> frontier(1, CopyPair(other.root_, root_));
+    while(!frontier.empty() && frontier.size() < target)
     {
-        //This will make sure we find the node before we 
-        //get to the nullptr
-        node = current;
-
-        //If already in the tree
-        if(keyValuePair.first == current->getKey())
-        {
-            found->setValue(keyValuePair.second); //update value if already in tree
-            return;
-        }
-        //If the key is less that the current key go left
-        else if(keyValuePair.first < current->getKey())
+        std::vector<CopyPair> next;
+        for(size_t i = 0; i < frontier.size(); ++i)
         {
-            current = current->getLeft();
-        }
-        //If the key is greater than the current key go right
-        else if(keyValuePair.first > current->getKey())
-        {
-            current = current->getRight();
+            const Node<Key, Value>* src = frontier[i].first;
+            Node<Key, Value>* dst = frontier[i].second;
+            if(src->getLeft() != nullptr)
+            {
+                Node<Key, Value>* left = src->getLeft()->clone();
+                left->setParent(dst);
+                dst->setLeft(left);
+                next.push_back(CopyPair(src->getLeft(), left));
+            }
+            if(src->getRight() != nullptr)
+            {
+                Node<Key, Value>* right = src->getRight()->clone();
+                right->setParent(dst);
+                dst->setRight(right);
+                next.push_back(CopyPair(src->getRight(), right));
+            }
         }
+        frontier.swap(next);
     }
-    //If the key is less than the node go left
-    if(keyValuePair.first < node->getKey())
+
+    std::atomic<size_t> nextSubtree(0);
+    std::vector<std::thread> workers;
+    for(unsigned t = 0; t < copyThreads_; ++t)
     {
-        node->setLeft(newNode);
+        workers.push_back(std::thread([&]() {
+            size_t i;
+            while((i = nextSubtree.fetch_add(1)) < frontier.size())
+            {
+                copyChildren(frontier[i].first, frontier[i].second);
+            }
+        }));
     }
-    //If the key is greater than the node go right
-    else if (keyValuePair.first > node->getKey())
+    for(unsigned t = 0; t < copyThreads_; ++t)
     {
-        node->setRight(newNode);
+        workers[t].join();
     }
-
-    //Make sure to update the parent
-    newNode->setParent(node);
 }
 
-
 /**
-* A remove method to remove a specific key from a Binary Search Tree.
-* Recall: The writeup specifies that if a node has 2 children you
-* should swap with the predecessor and then remove.
+ * Clones everything below src under dst, a childless clone of src, in
+ * one walk over the parent links of both trees: no stack or recursion.
 */
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::remove(const Key& key)
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::copyChildren(const Node<Key, Value>* src, Node<Key, Value>* dst)
 {
-    // TODO
-    //variable to hold the node we found (if found)
-    Node<Key,Value>* current = internalFind(key);
-
-    //If the item is not in the tree yet 
-    if(current == nullptr)
-    {
-        return;
-    }
-
-    //Case where the value has 0 children
-    if(current->getRight() == nullptr && current->getLeft() == nullptr)
+    const Node<Key, Value>* s = src;
+    Node<Key, Value>* d = dst;
+    while(true)
     {
-        //If the item is the root
-        if(current == root_ && current != nullptr)
+        Node<Key, Value>* child = NULL;
+        if(s->getLeft() != NULL && d->getLeft() == NULL)
         {
-            delete current;
-            root_ = nullptr;
-            return;
+            s = s->getLeft();
+            child = s->clone();
+            d->setLeft(child);
         }
-        else if(current->getParent()->getLeft() == current) //Left child
+        else if(s->getRight() != NULL && d->getRight() == NULL)
         {
-            //If it is the left child, then set the parent's left child
-            //to null and delete the node 
-            current->getParent()->setLeft(nullptr);
-            delete current;
-            return;
+            s = s->getRight();
+            child = s->clone();
+            d->setRight(child);
         }
-        else if(current->getParent()->getRight() == current) //right child
-        {
-            //If it is the right chiild, then set the parent's right child
-            //to null and delete the node 
-            current->getParent()->setRight(nullptr);
-            delete current;
-            return;
-        } 
-    }
-    //If the node has one child and that child is the left node
-    else if(current->getRight() == nullptr && current->getLeft() != nullptr)
-    {
-        //If current is the root
-        if(current == root_ && current != nullptr)
+        else if(s == src)
         {
-            //Promote the left child
-            root_ = root_->getLeft();
-
-            //Update the parent
-            root_->setParent(nullptr);
-
-            //Delete the node and return
-            delete current;
             return;
         }
-        else if(current->getParent()->getLeft() == current) //right child
+        else
         {
-            //Make the left child of the current node the right child of the
-            //current node's parent
-            nodeSwap(current, current->getRight());
-
-            //Delete the node and return
-            delete current;
-            return;
+            // Both children done: back up
+            s = s->getParent();
+            d = d->getParent();
+            continue;
         }
+        child->setParent(d);
+        d = child;
     }
-    //If the current node has one child and that child is the right node
-    else if(current->getRight() != nullptr && current->getLeft() == nullptr)
-    {
-        if(current == root_ && current != nullptr)
-        {
-            //Promote the child
-            root_ = root_->getRight();
-
-            //Update the parent
-            root_->setParent(nullptr);
+}
 
-            //Delete the current node and return
-            delete current;
-            return;
-        }
-        else if(current->getParent()->getRight() == current) //right child
-        {
-            //Make the right child of the current node the the child
-            //of the current parent 
-            nodeSwap(current, current->getLeft());
-            //Delete the node and return
-            delete current;
-            return;
-        }
-        
+/**
+ * Bookkeeping for a freshly allocated node, called before it is linked
+ * under the parent it was constructed with.
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::noteNodeAdded(Node<Key, Value>* node)
+{
+    ++nodeCount_;
+    if(nodeCount_ > peakNodeCount_)
+    {
+        peakNodeCount_ = nodeCount_;
     }
-    //If the node has two children 
-    else if(current->getRight() != nullptr && current->getLeft() != nullptr)
+    Node<Key, Value>* parent = node->getParent();
+    if(parent == nullptr || (parent == rightmost_ && parent->getKey() < node->getKey()))
     {
-        //Get the predecessor of the node we want and then we swap it 
-        Node<Key, Value>* predecessorNode = predecessor(current);
-        nodeSwap(current, predecessorNode);
-
-        //If the left child of the current node is valid
-        if (current->getLeft() != nullptr)
-        {
-            //If this is the right child then update pointers
-            if (current->getParent()->getRight() == current)
-            {
-                current->getParent()->setRight(current->getLeft());
-                current->getLeft()->setParent(current->getParent());
-
-                //Delete the node and return
-                delete current;
-                return;
-            }
-            //If this is the left child then update pointers
-            else if(current->getParent()->getLeft() == current)
-            {
-                current->getParent()->setLeft(current->getLeft());
-                current->getLeft()->setParent(current->getParent());
-
-                //Delete the node and return
-                delete current;
-                return;
-            }
-        }
-        //If the right child of the current node is valid
-        else if (current->getRight() != nullptr)
-        {
-            //If this is the right child then update the pointers
-            if (current->getParent()->getRight() == current)
-            {
-                current->getParent()->setRight(current->getRight());
-                current->getRight()->setParent(current->getParent());
-
-                //Delete the node and return
-                delete current;
-                return;
-            }
-            //If this is the left child then update the pointers
-            else if(current->getParent()->getLeft() == current)
-            {
-                current->getParent()->setLeft(current->getRight());
-                current->getRight()->setParent(current->getParent());
-
-                //Delete the node and return
-                delete current;
-                return;
-            }
-        }
-        //If both children are invalid 
-        else if(current->getRight() == nullptr && current->getLeft() == nullptr)
-        {
-            if (current->getParent()->getRight() == current)
-            {
-                current->getParent()->setRight(nullptr);
-            }
-            if (current->getParent()->getLeft() == current)
-            {
-                current->getParent()->setLeft(nullptr);
-            }
-
-            //Delete the node and return
-            delete current;
-            return;
-        }
+        rightmost_ = node;
     }
 }
 
-
+/**
+ * Bookkeeping for a node that was unlinked and is about to be freed
+*/
 template<class Key, class Value>
-Node<Key, Value>*
-BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current)
+void BinarySearchTree<Key, Value>::noteNodeRemoved(Node<Key, Value>* node)
 {
-    // TODO
-    //Node to hold a copy of the current node
-    Node<Key, Value>* node = current;
-
-    //If the node is invalid return null
-    if(node == nullptr)
+    --nodeCount_;
+    if(node == rightmost_)
     {
-        return nullptr;
+        rightmost_ = nullptr;
     }
-    //If the left child exists
-    if(node->getLeft() != nullptr)
-    {
-        //Move to the left child
-        node = node->getLeft();
+}
 
-        //While we can traverse right keep 
-        //going right
-        while(node->getRight() != NULL)
-        {
-            node = node->getRight();
-        }
-    }
-    //If the left node is invalid then we need
-    //to go up the ancestry tree
-    else if(node->getLeft() == nullptr)
+/**
+ * Starts recording latency histograms for insert, remove, find and
+ * iterator advancement on this tree. Each thread records into its own
+ * histograms, which latency() merges. Iterators created before the
+ * call are not tracked.
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::enableLatencyTracking()
+{
+    if(latency_ == nullptr)
     {
-        //While we can traverse
-        while( node != nullptr )
-        {
-            //Get the parrent and check
-            //to see if the parent is invalid
-            node = node->getParent();
-            if(node == nullptr)
-            {
-                return nullptr;
-            }
-            //once we find the first node that is the right child of
-            //the parent aabove us that is who we need
-            else if(node->getParent()->getRight() == node)
-            {
-                node = node->getParent();
-            }
-        }
+        latency_ = new TreeLatencyRecorder();
     }
-    
-    //get the node where it is the predecessor
-    return node;
 }
 
+/**
+ * Stops recording and discards the histograms. Any outstanding
+ * tracked iterators must not be advanced afterwards.
+*/
 template<class Key, class Value>
-Node<Key, Value>*
-BinarySearchTree<Key, Value>::successor(Node<Key, Value>* current)
+void BinarySearchTree<Key, Value>::disableLatencyTracking()
 {
-    // TODO
-    //Node to hold a copy of the current node
-    Node<Key, Value>* node = current;
+    delete latency_;
+    latency_ = nullptr;
+}
 
-    //If the node is invalid return null
-    if(node == nullptr)
-    {
-        return nullptr;
+/**
+ * Opt-in protection against sorted input: whenever an insert lands
+ * deeper than factor * log2(n), the subtree above it that is most out
+ * of weight balance is rebuilt perfectly balanced in linear time (as in
+ * a scapegoat tree). Depth stays O(log n) and inserts cost O(log n)
+ * amortized. factor must be greater than 1. Only insert() of the plain
+ * BinarySearchTree checks the limit; balanced subclasses don't need it.
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::enableAutoRebuild(double factor)
+{
+    if(factor <= 1.0)
+    {
+        throw std::invalid_argument("auto-rebuild factor must be greater than 1");
+    }
+    autoRebuildFactor_ = factor;
+}
+
+/**
+ * Goes back to never restructuring on insert.
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::disableAutoRebuild()
+{
+    autoRebuildFactor_ = 0;
+}
+
+/**
+ * Copies of this tree (and of those copies) clone disjoint subtrees on
+ * `threads` threads, for trees of hundreds of millions of nodes where
+ * even a linear copy takes seconds.
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::enableParallelCopy(unsigned threads)
+{
+    if(threads == 0)
+    {
+        throw std::invalid_argument("parallel copy needs at least one thread");
+    }
+    copyThreads_ = threads;
+}
+
+/**
+ * Goes back to copying on the calling thread.
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::disableParallelCopy()
+{
+    copyThreads_ = 1;
+}
+
+/**
+ * The histograms recorded so far, merged across all threads that used
+ * the tree (all empty if tracking is off). Safe to call while other
+ * threads are running const lookups and iterations.
+*/
+template<class Key, class Value>
+TreeLatency BinarySearchTree<Key, Value>::latency() const
+{
+    return latency_ != nullptr ? latency_->merged() : TreeLatency();
+}
+
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::print() const
+{
+    printRoot(root_);
+    std::cout << "\n";
+}
+
+/**
+* Returns an iterator to the "smallest" item in the tree
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::begin() const
+{
+    Node<Key, Value>* first = getSmallestNode();
+    while(tombstoneCount_ != 0 && first != NULL && first->isTombstone())
+    {
+        first = successor(first);
+    }
+    return makeIterator(first);
+}
+
+/**
+* Returns an iterator whose value means INVALID
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::end() const
+{
+    BinarySearchTree<Key, Value>::iterator end(NULL);
+    return end;
+}
+
+/**
+* Returns an iterator to the item with the given key, k
+* or the end iterator if k does not exist in the tree
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::find(const Key & k) const
+{
+    BST_STAT(STAT_FINDS, 1);
+    Node<Key, Value> *curr;
+    {
+        LatencyTimer timer(latency_ ? &latency_->local().find : NULL);
+        curr = findLive(k);
+    }
+    return makeIterator(curr);
+}
+
+/**
+* find(key) on a non-const tree: also reports a hit to accessed(), so
+* self-adjusting trees can restructure around it.
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::find(const Key & k)
+{
+    BST_STAT(STAT_FINDS, 1);
+    Node<Key, Value> *curr;
+    {
+        LatencyTimer timer(latency_ ? &latency_->local().find : NULL);
+        curr = findLive(k);
+        if(curr != NULL)
+        {
+            accessed(curr);
+        }
+    }
+    return makeIterator(curr);
+}
+
+/**
+* Like find(key), but starts the search at hint (end() stands for the
+* largest key), climbing only as far as needed: lookups near the hint
+* cost O(1) to O(log distance) instead of O(log n).
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::find(const iterator& hint, const Key& k) const
+{
+    BST_STAT(STAT_FINDS, 1);
+    Node<Key, Value> *curr;
+    {
+        LatencyTimer timer(latency_ ? &latency_->local().find : NULL);
+        curr = searchFrom(hint.current_, k).node;
+        if(curr != NULL && tombstoneCount_ != 0 && curr->isTombstone())
+        {
+            curr = NULL;
+        }
+    }
+    return makeIterator(curr);
+}
+
+/**
+* find(hint, key) on a non-const tree, reporting a hit to accessed().
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::find(const iterator& hint, const Key& k)
+{
+    BST_STAT(STAT_FINDS, 1);
+    Node<Key, Value> *curr;
+    {
+        LatencyTimer timer(latency_ ? &latency_->local().find : NULL);
+        curr = searchFrom(hint.current_, k).node;
+        if(curr != NULL && tombstoneCount_ != 0 && curr->isTombstone())
+        {
+            curr = NULL;
+        }
+        if(curr != NULL)
+        {
+            accessed(curr);
+        }
+    }
+    return makeIterator(curr);
+}
+
+/**
+* Called with the node a non-const find() or operator[] found. Does
+* nothing here; SplayTree splays it. Const lookups never call it.
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::accessed(Node<Key, Value>*)
+{
+}
+
+/**
+ * Wraps node in an iterator that records advance latency when tracking
+ * is enabled. Lets derived trees hand out iterators from their own
+ * lookups.
+ */
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::makeIterator(Node<Key, Value>* node) const
+{
+    BinarySearchTree<Key, Value>::iterator it(node, latency_);
+    return it;
+}
+
+/**
+ * The node an iterator points at (NULL for end()), for derived trees
+ * taking iterator hints.
+ */
+template<class Key, class Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::iteratorNode(const iterator& it)
+{
+    return it.current_;
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value>
+Value& BinarySearchTree<Key, Value>::operator[](const Key& key)
+{
+    Node<Key, Value> *curr = findLive(key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    accessed(curr);
+    return curr->getValue();
+}
+template<class Key, class Value>
+Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
+{
+    Node<Key, Value> *curr = findLive(key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+
+/**
+* An insert method to insert into a Binary Search Tree.
+* The tree will not remain balanced when inserting.
+* Recall: If key is already in the tree, you should 
+* overwrite the current value with the updated value.
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &keyValuePair)
+{
+    // TODO
+    BST_STAT(STAT_INSERTS, 1);
+    LatencyTimer timer(latency_ ? &latency_->local().insert : NULL);
+    insertAt(search(keyValuePair.first), keyValuePair);
+}
+
+/**
+* Inserts (or updates) starting the search at hint instead of the root,
+* and returns an iterator to the key. With a hint next to the key the
+* search costs O(1) instead of O(log n); for ascending keys, pass the
+* iterator returned by the previous insert or end(), which stands for
+* the largest key. Any hint gives the same result as insert(item).
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::insert(const iterator& hint, const std::pair<const Key, Value>& keyValuePair)
+{
+    BST_STAT(STAT_INSERTS, 1);
+    LatencyTimer timer(latency_ ? &latency_->local().insert : NULL);
+    return makeIterator(insertAt(searchFrom(hint.current_, keyValuePair.first), keyValuePair));
+}
+
+/**
+* Links a node for keyValuePair where found says (or updates the value
+* when found.node holds the key) and returns the node holding the key.
+* Trees override this to rebalance after the link.
+*/
+template<class Key, class Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::insertAt(const NodeSearch<Key, Value>& found,
+                                                         const std::pair<const Key, Value>& keyValuePair)
+{
+    //Check to see if the node already in the tree
+    //If so just update the value of the node
+    if(found.node != nullptr)
+    {
+        found.node->setValue(keyValuePair.second); //update value if already in tree
+        return found.node;
+    }
+    //Link the new node where the search fell off the tree
+    Node<Key, Value>* newNode = new Node<Key,Value> (keyValuePair.first, keyValuePair.second, found.parent);
+    noteNodeAdded(newNode);
+    if(found.parent == nullptr)
+    {
+        root_ = newNode;
+        return newNode;
+    }
+    if(found.left)
+    {
+        found.parent->setLeft(newNode);
+    }
+    else
+    {
+        found.parent->setRight(newNode);
+    }
+
+    if(autoRebuildFactor_ > 0)
+    {
+        int depth = found.depth >= 0 ? found.depth : nodeDepth(newNode);
+        if(depth > autoRebuildFactor_ * std::log2((double)nodeCount_))
+        {
+            rebuildScapegoat(newNode, std::pow(2.0, -1.0 / autoRebuildFactor_));
+        }
+    }
+    return newNode;
+}
+
+
+/**
+* A remove method to remove a specific key from a Binary Search Tree.
+* Recall: The writeup specifies that if a node has 2 children you
+* should swap with the predecessor and then remove.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::remove(const Key& key)
+{
+    // TODO
+    BST_STAT(STAT_REMOVES, 1);
+    LatencyTimer timer(latency_ ? &latency_->local().remove : NULL);
+
+    //variable to hold the node we found (if found)
+    Node<Key,Value>* current = internalFind(key);
+
+    //If the item is not in the tree yet 
+    if(current == nullptr)
+    {
+        return;
+    }
+
+    //If the node has two children, swap it with its predecessor
+    //so that it is left with at most one child
+    if(current->getRight() != nullptr && current->getLeft() != nullptr)
+    {
+        nodeSwap(current, predecessor(current));
+    }
+
+    //Unlink the node, promoting its only child (if any)
+    spliceOut(current);
+
+    //Delete the node and return
+    noteNodeRemoved(current);
+    delete current;
+}
+
+/**
+* Detaches a node with at most one child from the tree by linking
+* its child (or NULL) directly to its parent. The node itself is
+* not freed.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::spliceOut(Node<Key, Value>* node)
+{
+    //The child that takes the node's place
+    Node<Key, Value>* child = node->getLeft();
+    if(child == nullptr)
+    {
+        child = node->getRight();
+    }
+
+    Node<Key, Value>* parent = node->getParent();
+    if(child != nullptr)
+    {
+        child->setParent(parent);
+    }
+
+    //If the node is the root, promote the child
+    if(parent == nullptr)
+    {
+        root_ = child;
+    }
+    else if(parent->getLeft() == node)
+    {
+        parent->setLeft(child);
+    }
+    else
+    {
+        parent->setRight(child);
+    }
+
+    node->setParent(nullptr);
+    node->setLeft(nullptr);
+    node->setRight(nullptr);
+}
+
+
+template<class Key, class Value>
+Node<Key, Value>*
+BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current)
+{
+    // TODO
+    //Node to hold a copy of the current node
+    Node<Key, Value>* node = current;
+
+    //If the node is invalid return null
+    if(node == nullptr)
+    {
+        return nullptr;
+    }
+    //If the left child exists
+    if(node->getLeft() != nullptr)
+    {
+        //Move to the left child
+        node = node->getLeft();
+
+        //While we can traverse right keep 
+        //going right
+        while(node->getRight() != NULL)
+        {
+            node = node->getRight();
+        }
+    }
+    //If the left node is invalid then we need
+    //to go up the ancestry tree
+    else
+    {
+        //Climb while we are the left child of our parent; the first
+        //ancestor we reach from its right side is the predecessor
+        Node<Key, Value>* parent = node->getParent();
+        while(parent != nullptr && parent->getLeft() == node)
+        {
+            node = parent;
+            parent = parent->getParent();
+        }
+        node = parent;
+    }
+    
+    //get the node where it is the predecessor
+    return node;
+}
+
+template<class Key, class Value>
+Node<Key, Value>*
+BinarySearchTree<Key, Value>::successor(Node<Key, Value>* current)
+{
+    // TODO
+    //Node to hold a copy of the current node
+    Node<Key, Value>* node = current;
+
+    //If the node is invalid return null
+    if(node == nullptr)
+    {
+        return nullptr;
+    }
+    //If the right child exists
+    if(node->getRight() != nullptr)
+    {
+        //Move to the right child
+        node = node->getRight();
+
+        //While we can traverse left keep 
+        //going left
+        while(node->getLeft() != NULL)
+        {
+            node = node->getLeft();
+        }
+    }
+    //If the right node is invalid then we need
+    //to go up the ancestry tree
+    else
+    {
+        //Climb while we are the right child of our parent; the first
+        //ancestor we reach from its left side is the successor
+        Node<Key, Value>* parent = node->getParent();
+        while(parent != nullptr && parent->getRight() == node)
+        {
+            node = parent;
+            parent = parent->getParent();
+        }
+        node = parent;
+    }
+    
+    //get the node where it is the successor
+    return node;
+}
+
+
+/**
+* A method to remove all contents of the tree and
+* reset the values in the tree for use again.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::clear()
+{
+    // TODO
+    //Calling a helper function 
+    if(root_ == nullptr)
+    {
+        return;
+    }
+    clearHelper(root_);
+    root_ = nullptr;
+    nodeCount_ = 0;
+    tombstoneCount_ = 0;
+    rightmost_ = nullptr;
+}
+
+//Helper function to recursively delete all the nodes and
+//return the tree back to the empty state
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::clearHelper(Node<Key, Value>* node)
+{
+    //If the node is equal to NULL then we have deleted all the nodes
+    //including the root so just return
+    if(node == NULL)
+    {
+        return;
+    }
+    //Recurse into all the left children 
+    clearHelper(node->getLeft());
+
+    //Recurse into all the right children
+    clearHelper(node->getRight());
+
+    //Remove current node we are in from the tree
+    delete node;
+
+}
+/**
+* A helper function to find the smallest node in the tree.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>*
+BinarySearchTree<Key, Value>::getSmallestNode() const
+{
+    // TODO
+    //NOTE::The smallest node will ALWAYS be the left most
+    //Node of the tree
+
+    //Make a copy of the root to use as the pointer
+    //to the current node we are on
+    Node<Key, Value>* current = root_;
+    if(current == nullptr)
+    {
+        return nullptr;
+    }
+
+    //While we can iterate to the left traverse downward
+    //until we hit the nullptr indicating we are at the 
+    //smallest node of the tree
+    while(current->getLeft() != nullptr)
+    {
+        //Traverse downward to the left
+        current = current->getLeft();
+    }
+
+    //Return the smallest node in the given tree
+    return current;
+}
+
+/**
+* Removes every key in [first, last) and returns last. Whole subtrees
+* inside the range are detached and freed at once, so erasing k keys
+* costs O(k + log n) in balanced trees instead of k removes.
+*/
+template<typename Key, typename Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::erase(const iterator& first, const iterator& last)
+{
+    if(first == last)
+    {
+        return last;
+    }
+    Key low = first->first;
+    if(last == end())
+    {
+        eraseKeys(&low, NULL);
+    }
+    else
+    {
+        // last's node is not in the range, so it survives
+        eraseKeys(&low, &last->first);
+    }
+    return last;
+}
+
+/**
+* Removes every key k with low <= k < high and returns how many there
+* were. See erase(first, last).
+*/
+template<typename Key, typename Value>
+size_t BinarySearchTree<Key, Value>::eraseRange(const Key& low, const Key& high)
+{
+    if(!(low < high))
+    {
+        return 0;
+    }
+    return eraseKeys(&low, &high);
+}
+
+/**
+* Erases the keys in [*low, *high); a NULL bound is open. Splits the
+* tree into the keys below low, the range and the keys from high on,
+* frees the range and joins the two outer trees. Returns the number of
+* live keys erased.
+*/
+template<typename Key, typename Value>
+size_t BinarySearchTree<Key, Value>::eraseKeys(const Key* low, const Key* high)
+{
+    LatencyTimer timer(latency_ ? &latency_->local().remove : NULL);
+    Node<Key, Value>* less = NULL;
+    Node<Key, Value>* middle = root_;
+    Node<Key, Value>* rest = NULL;
+    int lessHeight = 0;
+    int middleHeight = splitHeight(root_);
+    int restHeight = 0;
+    if(low != NULL)
+    {
+        splitAt(middle, middleHeight, *low, less, lessHeight, middle, middleHeight);
+    }
+    if(high != NULL)
+    {
+        splitAt(middle, middleHeight, *high, middle, middleHeight, rest, restHeight);
+    }
+    size_t erased = freeSubtree(middle);
+    root_ = joinAll(less, lessHeight, rest, restHeight);
+    rightmost_ = nullptr;
+    return erased;
+}
+
+/**
+* Splits the tree at root (of the given height) into the keys less than
+* key and the rest, both with NULL parents. Only the nodes on the search
+* path are relinked.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::splitAt(Node<Key, Value>* root, int height, const Key& key,
+                                           Node<Key, Value>*& less, int& lessHeight,
+                                           Node<Key, Value>*& rest, int& restHeight)
+{
+    std::vector<SplitStep> path;
+    for(Node<Key, Value>* n = root; n != NULL;)
+    {
+        BST_STAT(STAT_COMPARISONS, 1);
+        SplitStep step = { n, height, n->getKey() < key };
+        path.push_back(step);
+        height = childHeight(n, height, !step.toLess);
+        n = step.toLess ? n->getRight() : n->getLeft();
+    }
+    less = NULL;
+    rest = NULL;
+    lessHeight = 0;
+    restHeight = 0;
+    splitPath(path, less, lessHeight, rest, restHeight);
+}
+
+/**
+* Bottom-up half of a split: each node on path joins the side it
+* belongs to together with its subtree on the far side of the path.
+* less and rest start as what hangs below the last step.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::splitPath(const std::vector<SplitStep>& path, Node<Key, Value>*& less,
+                                             int& lessHeight, Node<Key, Value>*& rest, int& restHeight)
+{
+    for(size_t i = path.size(); i-- > 0;)
+    {
+        Node<Key, Value>* n = path[i].node;
+        Node<Key, Value>* left = n->getLeft();
+        Node<Key, Value>* right = n->getRight();
+        int leftHeight = childHeight(n, path[i].height, true);
+        int rightHeight = childHeight(n, path[i].height, false);
+        n->setLeft(NULL);
+        n->setRight(NULL);
+        n->setParent(NULL);
+        if(path[i].toLess)
+        {
+            if(left != NULL)
+            {
+                left->setParent(NULL);
+            }
+            less = joinTrees(left, leftHeight, n, less, lessHeight, lessHeight);
+        }
+        else
+        {
+            if(right != NULL)
+            {
+                right->setParent(NULL);
+            }
+            rest = joinTrees(rest, restHeight, n, right, rightHeight, restHeight);
+        }
+    }
+}
+
+/**
+* Joins two trees whose keys are all ordered (less before rest) by
+* splitting off the smallest node of rest to put between them.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::joinAll(Node<Key, Value>* less, int lessHeight,
+                                                        Node<Key, Value>* rest, int restHeight)
+{
+    if(less == NULL || rest == NULL)
+    {
+        return less != NULL ? less : rest;
+    }
+    std::vector<SplitStep> spine;
+    Node<Key, Value>* smallest = rest;
+    int height = restHeight;
+    while(smallest->getLeft() != NULL)
+    {
+        SplitStep step = { smallest, height, false };
+        spine.push_back(step);
+        height = childHeight(smallest, height, true);
+        smallest = smallest->getLeft();
+    }
+    // What is left of rest: smallest's right subtree joined up the spine
+    Node<Key, Value>* right = smallest->getRight();
+    int rightHeight = childHeight(smallest, height, false);
+    if(right != NULL)
+    {
+        right->setParent(NULL);
+    }
+    Node<Key, Value>* parent = smallest->getParent();
+    if(parent != NULL)
+    {
+        parent->setLeft(NULL);
+    }
+    smallest->setRight(NULL);
+    smallest->setParent(NULL);
+    Node<Key, Value>* none = NULL;
+    int noneHeight = 0;
+    splitPath(spine, none, noneHeight, right, rightHeight);
+
+    int height2;
+    return joinTrees(less, lessHeight, smallest, right, rightHeight, height2);
+}
+
+/**
+* Makes mid, a detached node, the root over left and right (all of
+* left's keys before mid's, all of right's after) and returns the new
+* root. A plain BST just links them; balanced trees override this to
+* keep their invariants, using the subtree heights.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::joinTrees(Node<Key, Value>* left, int leftHeight,
+                                                          Node<Key, Value>* mid, Node<Key, Value>* right,
+                                                          int rightHeight, int& height)
+{
+    mid->setLeft(left);
+    mid->setRight(right);
+    if(left != NULL)
+    {
+        left->setParent(mid);
+    }
+    if(right != NULL)
+    {
+        right->setParent(mid);
+    }
+    height = 1 + std::max(leftHeight, rightHeight);
+    return mid;
+}
+
+/**
+* Height of the subtree at root for splits and joins. Trees that do not
+* need heights to join return 0 and skip the walk.
+*/
+template<typename Key, typename Value>
+int BinarySearchTree<Key, Value>::splitHeight(Node<Key, Value>* root) const
+{
+    return 0;
+}
+
+/**
+* Height of node's left or right subtree given node's own height; see
+* splitHeight().
+*/
+template<typename Key, typename Value>
+int BinarySearchTree<Key, Value>::childHeight(Node<Key, Value>* node, int height, bool left) const
+{
+    return 0;
+}
+
+/**
+* The node with the smallest key not less than key (tombstones
+* included), or NULL.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::lowerBound(const Key& key) const
+{
+    Node<Key, Value>* best = NULL;
+    for(Node<Key, Value>* n = root_; n != NULL;)
+    {
+        BST_STAT(STAT_COMPARISONS, 1);
+        if(n->getKey() < key)
+        {
+            n = n->getRight();
+        }
+        else
+        {
+            best = n;
+            n = n->getLeft();
+        }
+    }
+    return best;
+}
+
+/**
+* Deletes the subtree at root (already detached) without a stack and
+* returns how many live keys it held.
+*/
+template<typename Key, typename Value>
+size_t BinarySearchTree<Key, Value>::freeSubtree(Node<Key, Value>* root)
+{
+    size_t freed = 0;
+    size_t tombstones = 0;
+    while(root != NULL)
+    {
+        Node<Key, Value>* left = root->getLeft();
+        if(left != NULL)
+        {
+            // Rotate the left child up so the top never has one
+            root->setLeft(left->getRight());
+            left->setRight(root);
+            root = left;
+            continue;
+        }
+        Node<Key, Value>* next = root->getRight();
+        if(root->isTombstone())
+        {
+            ++tombstones;
+        }
+        ++freed;
+        delete root;
+        root = next;
+    }
+    nodeCount_ -= freed;
+    tombstoneCount_ -= tombstones;
+    return freed - tombstones;
+}
+
+/**
+* Moves every key of other into this tree, leaving other empty. For a
+* key in both, MERGE_OVERWRITE keeps other's value (as insert() would)
+* and MERGE_KEEP_EXISTING keeps this tree's.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::merge(BinarySearchTree& other, MergePolicy policy)
+{
+    if(policy == MERGE_OVERWRITE)
+    {
+        merge(other, [](const Value&, const Value& theirs) { return theirs; });
+    }
+    else
+    {
+        merge(other, [](const Value& ours, const Value&) { return ours; });
+    }
+}
+
+/**
+* Moves every key of other into this tree in O(n + m), however the keys
+* interleave: both trees are flattened in order, the sequences merged
+* and the nodes relinked as one perfectly balanced tree, without
+* allocating nodes. A key in both trees gets combine(ours, theirs) and
+* other's node is freed; tombstones are dropped. other must be the same
+* kind of tree, since its nodes are reused.
+*/
+template<typename Key, typename Value>
+template<typename Combine>
+void BinarySearchTree<Key, Value>::merge(BinarySearchTree& other, Combine combine)
+{
+    if(this == &other || other.root_ == NULL)
+    {
+        return;
+    }
+    if(typeid(*this) != typeid(other))
+    {
+        throw std::invalid_argument("merge() needs two trees of the same type");
+    }
+    std::vector<Node<Key, Value>*> ours;
+    std::vector<Node<Key, Value>*> theirs;
+    ours.reserve(nodeCount_);
+    theirs.reserve(other.nodeCount_);
+    flattenSubtree(root_, ours);
+    other.flattenSubtree(other.root_, theirs);
+    other.root_ = NULL;
+    other.nodeCount_ = 0;
+    other.tombstoneCount_ = 0;
+    other.rightmost_ = nullptr;
+
+    std::vector<Node<Key, Value>*> merged;
+    merged.reserve(ours.size() + theirs.size());
+    size_t i = 0;
+    size_t j = 0;
+    while(i < ours.size() || j < theirs.size())
+    {
+        Node<Key, Value>* next;
+        if(j == theirs.size() || (i < ours.size() && ours[i]->getKey() < theirs[j]->getKey()))
+        {
+            next = ours[i++];
+        }
+        else if(i == ours.size() || theirs[j]->getKey() < ours[i]->getKey())
+        {
+            next = theirs[j++];
+        }
+        else
+        {
+            next = ours[i++];
+            Node<Key, Value>* dup = theirs[j++];
+            if(next->isTombstone())
+            {
+                // Only other's key is live: it wins outright
+                delete next;
+                next = dup;
+            }
+            else
+            {
+                if(!dup->isTombstone())
+                {
+                    next->setValue(combine(next->getValue(), dup->getValue()));
+                }
+                delete dup;
+            }
+        }
+        BST_STAT(STAT_COMPARISONS, 1);
+        if(next->isTombstone())
+        {
+            delete next;
+            continue;
+        }
+        merged.push_back(next);
+    }
+
+    nodeCount_ = merged.size();
+    if(nodeCount_ > peakNodeCount_)
+    {
+        peakNodeCount_ = nodeCount_;
+    }
+    tombstoneCount_ = 0;
+    rightmost_ = nullptr;
+    root_ = linkBalanced(merged, NULL);
+    rebuiltTree();
+}
+
+/**
+* Like internalFind(), but treats a tombstoned node as absent.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::findLive(const Key& key) const
+{
+    Node<Key, Value>* node = internalFind(key);
+    if(node != NULL && tombstoneCount_ != 0 && node->isTombstone())
+    {
+        return NULL;
+    }
+    return node;
+}
+
+/**
+* Helper function to find a node with given key, k and
+* return a pointer to it or NULL if no item with that key
+* exists
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) const
+{
+    // TODO
+
+    return search(key).node;
+}
+
+/**
+* Single descent shared by lookups and inserts. Key comparisons go
+* through KeySearch, so string keys skip prefixes already known to
+* match (see key-search.h).
+*/
+template<typename Key, typename Value>
+NodeSearch<Key, Value> BinarySearchTree<Key, Value>::search(const Key& key) const
+{
+    return descend(root_, key, 0);
+}
+
+/**
+* Finger search: starts at finger (NULL: the largest node) and climbs
+* only until an ancestor bounds the key on the far side, then descends
+* from there. When nothing lies between finger and the key, the new
+* node goes straight under finger. The result's depth is -1 (unknown)
+* unless the search fell back to the root.
+*/
+template<typename Key, typename Value>
+NodeSearch<Key, Value> BinarySearchTree<Key, Value>::searchFrom(Node<Key, Value>* finger, const Key& key) const
+{
+    if(finger == nullptr)
+    {
+        finger = rightmost();
+        if(finger == nullptr)
+        {
+            return search(key);
+        }
     }
-    //If the right child exists
-    if(node->getRight() != nullptr)
+    NodeSearch<Key, Value> result = { nullptr, nullptr, false, -1 };
+    BST_STAT(STAT_COMPARISONS, 1);
+    bool right = finger->getKey() < key;
+    if(!right && !(key < finger->getKey()))
     {
-        //Move to the right child
-        node = node->getRight();
+        result.node = finger;
+        return result;
+    }
 
-        //While we can traverse left keep 
-        //going left
-        while(node->getLeft() != NULL)
+    // The largest node bounds nothing on its right: skip the climb
+    Node<Key, Value>* near = right ? finger->getRight() : finger->getLeft();
+    if(right && finger == rightmost_ && near == nullptr)
+    {
+        result.parent = finger;
+        return result;
+    }
+
+    // Climb while key lies beyond the subtree of top. An ancestor reached
+    // from its near side bounds top's keys; the first one is finger's
+    // in-order neighbour.
+    Node<Key, Value>* top = finger;
+    bool passedNeighbour = false;
+    for(Node<Key, Value>* p = top->getParent(); p != nullptr; top = p, p = p->getParent())
+    {
+        if((right ? p->getLeft() : p->getRight()) != top)
         {
-            node = node->getLeft();
+            continue;
+        }
+        BST_STAT(STAT_COMPARISONS, 1);
+        if(right ? key < p->getKey() : p->getKey() < key)
+        {
+            break;
+        }
+        if(!(key < p->getKey()) && !(p->getKey() < key))
+        {
+            result.node = p;
+            return result;
         }
+        passedNeighbour = true;
     }
-    //If the right node is invalid then we need
-    //to go up the ancestry tree
-    else if(node->getRight() == nullptr)
+
+    // Key lies between finger and its neighbour: under finger, either
+    // directly or in finger's subtree on that side
+    if(!passedNeighbour)
     {
-        //While we can traverse
-        while( node != nullptr )
+        if(near == nullptr)
         {
-            //Get the parrent and check
-            //to see if the parent is invalid
-            node = node->getParent();
-            if(node == nullptr)
-            {
-                return nullptr;
-            }
-            //once we find the first node that is the left child of
-            //the parent aabove us that is who we need
-            else if(node->getLeft() == node)
-            {
-                node = node->getParent();
-            }
+            result.parent = finger;
+            result.left = !right;
+            return result;
         }
+        top = near;
     }
-    
-    //get the node where it is the predecessor
-    return node;
+    result = descend(top, key, 0);
+    result.depth = -1;
+    return result;
 }
 
+/**
+* Plain descent from top, which sits at the given depth.
+*/
+template<typename Key, typename Value>
+NodeSearch<Key, Value> BinarySearchTree<Key, Value>::descend(Node<Key, Value>* top, const Key& key, int depth) const
+{
+    NodeSearch<Key, Value> result = { nullptr, top == nullptr ? nullptr : top->getParent(), false, depth };
+    if(result.parent != nullptr)
+    {
+        result.left = result.parent->getLeft() == top;
+    }
+    KeySearch<Key> compare(key);
+    Node<Key, Value>* current = top;
+    while(current != nullptr)
+    {
+        BST_STAT(STAT_COMPARISONS, 1);
+        int order = compare.compare(current->getKey());
+        if(order == 0)
+        {
+            result.node = current;
+            return result;
+        }
+        result.parent = current;
+        result.left = order < 0;
+        ++result.depth;
+        current = order < 0 ? current->getLeft() : current->getRight();
+    }
+    return result;
+}
 
 /**
-* A method to remove all contents of the tree and
-* reset the values in the tree for use again.
+* The largest node, cached between calls (NULL when empty).
 */
 template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::clear()
+Node<Key, Value>* BinarySearchTree<Key, Value>::rightmost() const
 {
-    // TODO
-    //Calling a helper function 
-    if(root_ == nullptr)
+    if(rightmost_ == nullptr && root_ != nullptr)
     {
-        return;
+        rightmost_ = root_;
+        while(rightmost_->getRight() != nullptr)
+        {
+            rightmost_ = rightmost_->getRight();
+        }
     }
-    clearHelper(root_);
-    root_ = nullptr;
+    return rightmost_;
 }
 
-//Helper function to recursively delete all the nodes and
-//return the tree back to the empty state
+/**
+* Edges from the root down to node.
+*/
 template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::clearHelper(Node<Key, Value>* node)
+int BinarySearchTree<Key, Value>::nodeDepth(Node<Key, Value>* node)
 {
-    //If the node is equal to NULL then we have deleted all the nodes
-    //including the root so just return
-    if(node == NULL)
+    int depth = 0;
+    for(Node<Key, Value>* p = node->getParent(); p != nullptr; p = p->getParent())
     {
-        return;
+        ++depth;
     }
-    //Recurse into all the left children 
-    clearHelper(node->getLeft());
+    return depth;
+}
 
-    //Recurse into all the right children
-    clearHelper(node->getRight());
+/**
+ * Return true if the BST is balanced.
+ */
+template<typename Key, typename Value>
+bool BinarySearchTree<Key, Value>::isBalanced() const
+{
+    // TODO
+    return balancehelper(root_) >= 0;
+}
 
-    //Remove current node we are in from the tree
-    delete node;
+/**
+ * Returns the height of the tree (0 when empty)
+ */
+template<typename Key, typename Value>
+int BinarySearchTree<Key, Value>::height() const
+{
+    return subtreeHeight(root_);
+}
 
+/**
+ * Returns leaf depth histogram, average/max depth, internal path length
+ * and the one-child fraction in a single traversal, split across
+ * `threads` threads for large trees.
+ */
+template<typename Key, typename Value>
+ShapeReport BinarySearchTree<Key, Value>::shapeReport(unsigned threads) const
+{
+    return analyzeShape(root_, NodeChildren<Key, Value>(), threads);
 }
+
 /**
-* A helper function to find the smallest node in the tree.
+ * Height of the subtree rooted at node. A plain BST has to walk the
+ * whole subtree; balanced trees override this with something cheaper.
+ */
+template<typename Key, typename Value>
+int BinarySearchTree<Key, Value>::subtreeHeight(Node<Key, Value>* node) const
+{
+    return depth(node);
+}
+
+//Computes the height of the subtree in one post-order pass and returns
+//it, or -1 as soon as some node's children differ in height by more
+//than one. Uses an explicit stack so degenerate trees cannot overflow
+//the call stack.
+template<typename Key, typename Value>
+int BinarySearchTree<Key, Value>::balancehelper(Node<Key,Value>* root ) const
+{
+    //Nodes still to visit; the flag marks nodes whose children are done
+    std::vector<std::pair<Node<Key, Value>*, bool> > todo;
+
+    //Heights of the finished subtrees, left before right
+    std::vector<int> heights;
+
+    todo.push_back(std::make_pair(root, false));
+    while(!todo.empty())
+    {
+        Node<Key, Value>* node = todo.back().first;
+        bool childrenDone = todo.back().second;
+        todo.pop_back();
+
+        //An empty subtree has height 0
+        if(node == NULL)
+        {
+            heights.push_back(0);
+        }
+        else if(!childrenDone)
+        {
+            todo.push_back(std::make_pair(node, true));
+            todo.push_back(std::make_pair(node->getRight(), false));
+            todo.push_back(std::make_pair(node->getLeft(), false));
+        }
+        else
+        {
+            int rightH = heights.back();
+            heights.pop_back();
+            int leftH = heights.back();
+            heights.pop_back();
+
+            //If the heights differ by more than 1 the tree is not balanced
+            if(abs(leftH - rightH) > 1)
+            {
+                return -1;
+            }
+            heights.push_back(1 + std::max(leftH, rightH));
+        }
+    }
+    return heights.back();
+}
+
+//Counts the levels of the subtree breadth first so that the
+//height of a degenerate tree does not recurse once per node
+template<typename Key, typename Value>
+int BinarySearchTree<Key, Value>::depth(Node<Key,Value>* node) const
+{
+    //Value to tell the heigh to of
+    //the trees
+    int value = 0;
+
+    std::vector<Node<Key, Value>*> level;
+    if(node != NULL)
+    {
+        level.push_back(node);
+    }
+
+    //Each pass replaces the current level with its children
+    while(!level.empty())
+    {
+        value++;
+        std::vector<Node<Key, Value>*> next;
+        for(size_t i = 0; i < level.size(); ++i)
+        {
+            if(level[i]->getLeft() != NULL)
+            {
+                next.push_back(level[i]->getLeft());
+            }
+            if(level[i]->getRight() != NULL)
+            {
+                next.push_back(level[i]->getRight());
+            }
+        }
+        level.swap(next);
+    }
+    return value;
+}
+
+
+/**
+* Rotates the subtree at p to the right: p's left child takes p's place
+* and p becomes its right child. Balanced trees build on this.
 */
 template<typename Key, typename Value>
-Node<Key, Value>*
-BinarySearchTree<Key, Value>::getSmallestNode() const
+void BinarySearchTree<Key, Value>::rotateRight(Node<Key, Value>* p)
 {
-    // TODO
-    //NOTE::The smallest node will ALWAYS be the left most
-    //Node of the tree
+    //variable to hold the left child of parent
+    Node<Key, Value>* leftChild = p->getLeft();
 
-    //Make a copy of the root to use as the pointer
-    //to the current node we are on
-    Node<Key, Value>* current = root_;
+    //Update the left child
+    Node<Key, Value>* p_parent = p->getParent();
+    leftChild->setParent(p_parent);
 
-    //While we can iterate to the left traverse downward
-    //until we hit the nullptr indicating we are at the 
-    //smallest node of the tree
-    while(current->getLeft() != nullptr)
+    //Update the parent
+    Node<Key, Value>* l_right = leftChild->getRight();
+    p->setLeft(l_right);
+
+    //If the left child of the parent is invalid
+    if(l_right != nullptr)
     {
-        //Traverse downward to the left
-        current = current->getLeft();
+        l_right->setParent(p);
     }
 
-    //Return the smallest node in the given tree
-    return current;
+    //Update the right child of the left child
+    leftChild->setRight(p);
+    p->setParent(leftChild);
+
+    //Update the parent of the new parent node
+    if(p_parent == nullptr)
+    {
+        root_ = leftChild;
+    }
+    else if(p_parent->getLeft() == p)
+    {
+        p_parent->setLeft(leftChild);
+    }
+    else
+    {
+        p_parent->setRight(leftChild);
+    }
 }
 
 /**
-* Helper function to find a node with given key, k and
-* return a pointer to it or NULL if no item with that key
-* exists
+* Mirror image of rotateRight(): p's right child takes p's place.
 */
 template<typename Key, typename Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) const
+void BinarySearchTree<Key, Value>::rotateLeft(Node<Key, Value>* p)
 {
-    // TODO
+    //Variable to hold the right child of the parent
+    Node<Key, Value>* rightChild = p->getRight();
 
-    //A copy to hold the root of the tree
-    Node<Key, Value>* current = root_;
-    while(current != nullptr)
+    //Update the right child
+    Node<Key, Value>* p_parent = p->getParent();
+    rightChild->setParent(p_parent);
+
+    //Update the parent
+    Node<Key, Value>* r_left = rightChild->getLeft();
+    p->setRight(r_left);
+
+    //If the right child is invalid
+    if(r_left != nullptr)
     {
-        //If the key is less than the parent key
-        //Go to the left child
-        if(key < current->getKey())
-        {
-            current = current->getLeft();
-        }
-        //If the key is greater than the parent key
-        //GO to the right child
-        else if(key > current->getKey())
-        {
-            current = current->getRight();
-        }
-        //If the key is equal to the parent key
-        //We have found the node so just return it 
-        else if(key == current->getKey())
+        r_left->setParent(p);
+    }
+
+    //Update the left child of the right child
+    rightChild->setLeft(p);
+    p->setParent(rightChild);
+
+    //Update the parent of the new parent node
+    if(p_parent == nullptr)
+    {
+        root_ = rightChild;
+    }
+    else if(p_parent->getLeft() == p)
+    {
+        p_parent->setLeft(rightChild);
+    }
+    else
+    {
+        p_parent->setRight(rightChild);
+    }
+}
+
+/**
+* Appends the nodes of the subtree at root to out in key order.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::flattenSubtree(Node<Key, Value>* root, std::vector<Node<Key, Value>*>& out) const
+{
+    std::vector<Node<Key, Value>*> stack;
+    Node<Key, Value>* curr = root;
+    while(curr != nullptr || !stack.empty())
+    {
+        while(curr != nullptr)
         {
-            return current;
+            stack.push_back(curr);
+            curr = curr->getLeft();
         }
+        curr = stack.back();
+        stack.pop_back();
+        out.push_back(curr);
+        curr = curr->getRight();
     }
+}
 
-    //If no NODE was found from the given key, the node does
-    //not exist so just return NULL
-    return nullptr;
+/**
+* Relinks the sorted nodes into a perfectly balanced tree hanging from
+* parent and returns its root (nullptr when nodes is empty). Does not
+* attach the root to parent or root_; see rebuildSubtree().
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::linkBalanced(const std::vector<Node<Key, Value>*>& nodes,
+                                                           Node<Key, Value>* parent)
+{
+    Node<Key, Value>* subtree = nullptr;
+    linkBalancedRange(nodes, 0, nodes.size(), parent, subtree);
+    return subtree;
 }
 
 /**
- * Return true if the BST is balanced.
- */
+* Builds nodes[lo, hi) under parent, middle element first. Returns the
+* height of the result; the recursion is only O(log n) deep.
+*/
 template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::isBalanced() const
+int BinarySearchTree<Key, Value>::linkBalancedRange(const std::vector<Node<Key, Value>*>& nodes, size_t lo,
+                                                    size_t hi, Node<Key, Value>* parent,
+                                                    Node<Key, Value>*& subtree)
 {
-    // TODO
-    return balancehelper(root_);
+    if(lo >= hi)
+    {
+        subtree = nullptr;
+        return 0;
+    }
+    size_t mid = lo + (hi - lo) / 2;
+    Node<Key, Value>* node = nodes[mid];
+    node->setParent(parent);
+
+    Node<Key, Value>* left;
+    Node<Key, Value>* right;
+    int leftHeight = linkBalancedRange(nodes, lo, mid, node, left);
+    int rightHeight = linkBalancedRange(nodes, mid + 1, hi, node, right);
+    node->setLeft(left);
+    node->setRight(right);
+    rebuiltNode(node, leftHeight, rightHeight);
+    subtree = node;
+    return 1 + std::max(leftHeight, rightHeight);
 }
 
+/**
+* Rebuilds the subtree at root into a perfectly balanced one in linear
+* time, reusing its nodes, and puts it back where root was. Returns the
+* new subtree root.
+*/
 template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::balancehelper(Node<Key,Value>* root ) const
+Node<Key, Value>* BinarySearchTree<Key, Value>::rebuildSubtree(Node<Key, Value>* root)
 {
-    //If the tree is empty then it is balanced
-    if(root == NULL)
+    if(root == nullptr)
     {
-        return true;
+        return nullptr;
     }
+    Node<Key, Value>* parent = root->getParent();
+    bool wasLeft = parent != nullptr && parent->getLeft() == root;
 
-    //Get the inter heights of the right and 
-    //left sides of all trees 
-    int leftH = depth(root->getLeft());
-    int rightH = depth(root->getRight());
+    std::vector<Node<Key, Value>*> nodes;
+    flattenSubtree(root, nodes);
+    Node<Key, Value>* rebuilt = linkBalanced(nodes, parent);
+
+    if(parent == nullptr)
+    {
+        root_ = rebuilt;
+    }
+    else if(wasLeft)
+    {
+        parent->setLeft(rebuilt);
+    }
+    else
+    {
+        parent->setRight(rebuilt);
+    }
+    return rebuilt;
+}
 
-    //If the height is 1 or 0 then the tree is balanced
-    if(abs(leftH- rightH) == 1 || leftH - rightH == 0)
+/**
+* After an insert that landed too deep, climbs from the new node to the
+* first ancestor with a child holding more than alpha of its subtree
+* and rebuilds that subtree. If the new node is deeper than
+* log_{1/alpha}(n), such an ancestor exists. Sizes are counted on the
+* way up, so the cost is linear in the rebuilt subtree. Returns whether
+* anything was rebuilt.
+*/
+template<typename Key, typename Value>
+bool BinarySearchTree<Key, Value>::rebuildScapegoat(Node<Key, Value>* inserted, double alpha)
+{
+    Node<Key, Value>* child = inserted;
+    size_t childSize = 1;
+    while(child->getParent() != nullptr)
     {
-        //Balanced so return true
-        if(balancehelper(root->getLeft()) == true && balancehelper(root->getRight()) == true)
+        BST_STAT(STAT_REBALANCE_STEPS, 1);
+        Node<Key, Value>* node = child->getParent();
+        Node<Key, Value>* sibling = node->getLeft() == child ? node->getRight() : node->getLeft();
+        size_t size = childSize + 1 + subtreeSize(sibling);
+        if((double)childSize > alpha * (double)size)
         {
+            rebuildSubtree(node);
             return true;
         }
+        child = node;
+        childSize = size;
     }
-
-    //Not balanced so return false
     return false;
 }
+
+/**
+* Number of nodes in the subtree at root.
+*/
 template<typename Key, typename Value>
-int BinarySearchTree<Key, Value>::depth(Node<Key,Value>* node) const
+size_t BinarySearchTree<Key, Value>::subtreeSize(Node<Key, Value>* root)
 {
-    //Value to tell the heigh to of
-    //the trees
-    int value = 0;
-
-    //Base case to break the recursion 
-    if (node == NULL)
-    {
-        return 0;
-    }
-    //If the left tree is greater than right tree
-    if(depth(node->getLeft()) >  depth(node->getRight()))
+    size_t count = 0;
+    std::vector<Node<Key, Value>*> stack;
+    if(root != nullptr)
     {
-        value = depth(node->getLeft());
+        stack.push_back(root);
     }
-    //If the right tree is greater than the left tree
-    else if(depth(node->getLeft()) < depth(node->getRight()))
+    while(!stack.empty())
     {
-        value = depth(node->getRight());
+        Node<Key, Value>* node = stack.back();
+        stack.pop_back();
+        ++count;
+        if(node->getLeft() != nullptr)
+        {
+            stack.push_back(node->getLeft());
+        }
+        if(node->getRight() != nullptr)
+        {
+            stack.push_back(node->getRight());
+        }
     }
+    return count;
+}
 
-    //Increment the value of the tree we are
-    //checking and return it to the recursive call
-    value++;
-    return value;
+/**
+* Called once linkBalanced() has relinked the whole tree (by merge()),
+* for trees whose per-node data depends on more than child heights.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::rebuiltTree()
+{
 }
 
+/**
+* Called for every node placed by linkBalanced() once its children are
+* linked, with the heights of both child subtrees. Trees that keep
+* per-node balance data reset it here.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::rebuiltNode(Node<Key, Value>*, int, int)
+{
+}
 
 template<typename Key, typename Value>
 void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
@@ -987,6 +2360,7 @@ void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value
     if((n1 == n2) || (n1 == NULL) || (n2 == NULL) ) {
         return;
     }
+    BST_STAT(STAT_NODE_SWAPS, 1);
     Node<Key, Value>* n1p = n1->getParent();
     Node<Key, Value>* n1r = n1->getRight();
     Node<Key, Value>* n1lt = n1->getLeft();
@@ -1079,6 +2453,9 @@ void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value
 // include print function (in its own file because it's fairly long)
 #include "print_bst.h"
 
+// include DOT/JSON exporter (same reason)
+#include "export_bst.h"
+
 /*
 ---------------------------------------------------
 End implementations for the BinarySearchTree class.
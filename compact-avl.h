@@ -0,0 +1,728 @@
+#ifndef COMPACT_AVL_H
+#define COMPACT_AVL_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "tree-memory.h"
+#include "tree-stats.h"
+#include "shape-report.h"
+#include "key-search.h"
+
+/**
+ * A node of a CompactAVLTree. Links are 32-bit slot indices into the
+ * tree's node array (0 means none) and the AVL balance lives in the top
+ * bit of each child link: set on the left link when the left subtree is
+ * taller, on the right link when the right one is. For int keys and
+ * values that is 20 bytes a node, with no vtable, no per-node heap
+ * header and no padding.
+ */
+template<typename Key, typename Value>
+struct CompactNode {
+    std::pair<Key, Value> item;
+    uint32_t left;
+    uint32_t right;
+    uint32_t parent;
+
+    CompactNode() : item(), left(0), right(0), parent(0) {}
+};
+
+/**
+ * Bookkeeping of a CompactAVLTree. It is kept by the node storage so
+ * that storage backed by a file or shared memory carries the whole tree.
+ */
+struct CompactTreeHeader {
+    uint32_t root;       // slot of the root, 0 when empty
+    uint32_t freeList;   // first released slot, chained through left
+    uint32_t slots;      // slots handed out so far (slot 0 is never used)
+    uint32_t peakNodes;
+    uint64_t count;      // live nodes
+
+    CompactTreeHeader() : root(0), freeList(0), slots(1), peakNodes(0), count(0) {}
+};
+
+/**
+ * Child accessor for the generic shape analysis (shape-report.h): turns
+ * slot indices into node pointers, 0 into NULL.
+ */
+template<typename NodeType>
+struct CompactNodeChildren {
+    explicit CompactNodeChildren(const NodeType* nodes) : nodes_(nodes) {}
+
+    void operator()(const NodeType* node, const NodeType*& left, const NodeType*& right) const
+    {
+        uint32_t l = node->left & 0x7fffffffu;
+        uint32_t r = node->right & 0x7fffffffu;
+        left = l != 0 ? nodes_ + l : NULL;
+        right = r != 0 ? nodes_ + r : NULL;
+    }
+
+    const NodeType* nodes_;
+};
+
+/**
+ * Default storage for a CompactAVLTree: one std::vector of nodes,
+ * doubled when full. Growing moves the nodes, but links are indices so
+ * nothing needs fixing up.
+ *
+ * Storage policies provide nodes() (the slot array), capacity(),
+ * grow(minSlots), header() and reset().
+ */
+template<typename NodeType>
+class VectorNodeStorage
+{
+public:
+    VectorNodeStorage() : nodes_(1) {}
+
+    NodeType* nodes() { return &nodes_[0]; }
+    const NodeType* nodes() const { return &nodes_[0]; }
+    size_t capacity() const { return nodes_.size(); }
+    CompactTreeHeader& header() { return header_; }
+    const CompactTreeHeader& header() const { return header_; }
+
+    void grow(size_t minSlots)
+    {
+        nodes_.resize(std::max(minSlots, nodes_.size() * 2));
+    }
+
+    void reset()
+    {
+        std::vector<NodeType>(1).swap(nodes_);
+        header_ = CompactTreeHeader();
+    }
+
+private:
+    std::vector<NodeType> nodes_;
+    CompactTreeHeader header_;
+};
+
+/**
+ * An AVL tree over a contiguous node array with 32-bit links and the
+ * balance packed into spare link bits (see CompactNode). Same map
+ * operations as AVLTree; up to 2^31 - 1 nodes. Nodes sit next to each
+ * other in slot order, which also helps locality for small keys.
+ *
+ * Iterators hold a slot index and stay valid across inserts (even when
+ * the array grows). remove() may move another key's item into the
+ * removed slot, so it invalidates iterators other than end().
+ */
+template<typename Key, typename Value, typename Storage = VectorNodeStorage<CompactNode<Key, Value> > >
+class CompactAVLTree
+{
+public:
+    typedef CompactNode<Key, Value> NodeType;
+
+    class iterator
+    {
+    public:
+        iterator() : tree_(NULL), slot_(0) {}
+
+        // Changing the key through the pair would corrupt the tree
+        std::pair<Key, Value>& operator*() const { return tree_->at(slot_).item; }
+        std::pair<Key, Value>* operator->() const { return &tree_->at(slot_).item; }
+
+        bool operator==(const iterator& rhs) const { return slot_ == rhs.slot_; }
+        bool operator!=(const iterator& rhs) const { return slot_ != rhs.slot_; }
+
+        iterator& operator++()
+        {
+            slot_ = tree_->successor(slot_);
+            return *this;
+        }
+
+    private:
+        friend class CompactAVLTree<Key, Value, Storage>;
+        iterator(const CompactAVLTree* tree, uint32_t slot) : tree_(const_cast<CompactAVLTree*>(tree)), slot_(slot) {}
+
+        CompactAVLTree* tree_;
+        uint32_t slot_;
+    };
+
+    CompactAVLTree() {}
+    explicit CompactAVLTree(const Storage& storage) : storage_(storage) {}
+
+    void insert(const std::pair<const Key, Value>& item);
+    void remove(const Key& key);
+    iterator find(const Key& key) const;
+    iterator begin() const;
+    iterator end() const { return iterator(this, 0); }
+    Value& operator[](const Key& key);
+
+    void clear() { storage_.reset(); }
+    void reserve(size_t nodes);
+    bool empty() const { return header().count == 0; }
+    size_t size() const { return (size_t)header().count; }
+    int height() const;
+    bool isBalanced() const;
+    ShapeReport shapeReport(unsigned threads = 1) const;
+    MemoryReport memoryReport() const;
+    size_t capacityBytes() const { return storage_.capacity() * sizeof(NodeType); }
+
+    Storage& storage() { return storage_; }
+
+protected:
+    static const uint32_t TALLER = 0x80000000u;
+    static const uint32_t INDEX = 0x7fffffffu;
+
+    NodeType& at(uint32_t slot) { return storage_.nodes()[slot]; }
+    const NodeType& at(uint32_t slot) const { return storage_.nodes()[slot]; }
+    CompactTreeHeader& header() { return storage_.header(); }
+    const CompactTreeHeader& header() const { return storage_.header(); }
+
+    // Link and balance accessors
+    uint32_t left(uint32_t n) const { return at(n).left & INDEX; }
+    uint32_t right(uint32_t n) const { return at(n).right & INDEX; }
+    uint32_t parent(uint32_t n) const { return at(n).parent; }
+    void setLeft(uint32_t n, uint32_t c) { at(n).left = (at(n).left & TALLER) | c; }
+    void setRight(uint32_t n, uint32_t c) { at(n).right = (at(n).right & TALLER) | c; }
+    void setParent(uint32_t n, uint32_t p) { at(n).parent = p; }
+    int balance(uint32_t n) const;
+    void setBalance(uint32_t n, int balance);
+
+    uint32_t allocate();
+    void release(uint32_t slot);
+    uint32_t search(const Key& key, uint32_t& parentSlot, bool& leftSide) const;
+    uint32_t successor(uint32_t n) const;
+    void replaceChild(uint32_t p, uint32_t oldChild, uint32_t newChild);
+    void rotateLeft(uint32_t p);
+    void rotateRight(uint32_t p);
+    int rebalance(uint32_t g, int s);
+    void insert_fix(uint32_t p, uint32_t n);
+    void remove_fix(uint32_t n, int diff);
+
+    Storage storage_;
+};
+
+/**
+ * -1 when the left subtree is taller, 1 when the right one is, else 0.
+ */
+template<typename Key, typename Value, typename Storage>
+int CompactAVLTree<Key, Value, Storage>::balance(uint32_t n) const
+{
+    return (at(n).right & TALLER ? 1 : 0) - (at(n).left & TALLER ? 1 : 0);
+}
+
+template<typename Key, typename Value, typename Storage>
+void CompactAVLTree<Key, Value, Storage>::setBalance(uint32_t n, int balance)
+{
+    NodeType& node = at(n);
+    node.left = (node.left & INDEX) | (balance < 0 ? TALLER : 0);
+    node.right = (node.right & INDEX) | (balance > 0 ? TALLER : 0);
+}
+
+/**
+ * Makes room for at least `nodes` nodes up front.
+ */
+template<typename Key, typename Value, typename Storage>
+void CompactAVLTree<Key, Value, Storage>::reserve(size_t nodes)
+{
+    if(nodes + 1 > storage_.capacity())
+    {
+        storage_.grow(nodes + 1);
+    }
+}
+
+/*
+ * Takes a slot off the free list, or the next never-used one.
+ */
+template<typename Key, typename Value, typename Storage>
+uint32_t CompactAVLTree<Key, Value, Storage>::allocate()
+{
+    // Storage may move the header as well when it grows
+    uint32_t slot = header().freeList;
+    if(slot != 0)
+    {
+        header().freeList = at(slot).left & INDEX;
+    }
+    else
+    {
+        if(header().slots > INDEX)
+        {
+            throw std::length_error("CompactAVLTree is limited to 2^31 - 1 nodes");
+        }
+        if(header().slots >= storage_.capacity())
+        {
+            storage_.grow((size_t)header().slots + 1);
+        }
+        slot = header().slots++;
+    }
+    ++header().count;
+    if(header().count > header().peakNodes)
+    {
+        header().peakNodes = (uint32_t)header().count;
+    }
+    return slot;
+}
+
+/*
+ * Puts a slot on the free list and drops what its item owned.
+ */
+template<typename Key, typename Value, typename Storage>
+void CompactAVLTree<Key, Value, Storage>::release(uint32_t slot)
+{
+    NodeType& node = at(slot);
+    node.item = std::pair<Key, Value>();
+    node.left = header().freeList;
+    node.right = 0;
+    node.parent = 0;
+    header().freeList = slot;
+    --header().count;
+}
+
+/*
+ * Slot holding key, or 0 with parentSlot/leftSide telling where a new
+ * node for it would be linked.
+ */
+template<typename Key, typename Value, typename Storage>
+uint32_t CompactAVLTree<Key, Value, Storage>::search(const Key& key, uint32_t& parentSlot, bool& leftSide) const
+{
+    KeySearch<Key> compare(key);
+    parentSlot = 0;
+    leftSide = false;
+    uint32_t n = header().root;
+    while(n != 0)
+    {
+        BST_STAT(STAT_COMPARISONS, 1);
+        int order = compare.compare(at(n).item.first);
+        if(order == 0)
+        {
+            return n;
+        }
+        parentSlot = n;
+        leftSide = order < 0;
+        n = order < 0 ? left(n) : right(n);
+    }
+    return 0;
+}
+
+template<typename Key, typename Value, typename Storage>
+typename CompactAVLTree<Key, Value, Storage>::iterator CompactAVLTree<Key, Value, Storage>::find(const Key& key) const
+{
+    BST_STAT(STAT_FINDS, 1);
+    uint32_t parentSlot;
+    bool leftSide;
+    return iterator(this, search(key, parentSlot, leftSide));
+}
+
+template<typename Key, typename Value, typename Storage>
+typename CompactAVLTree<Key, Value, Storage>::iterator CompactAVLTree<Key, Value, Storage>::begin() const
+{
+    uint32_t n = header().root;
+    while(n != 0 && left(n) != 0)
+    {
+        n = left(n);
+    }
+    return iterator(this, n);
+}
+
+/**
+ * @precondition The key exists in the map
+ */
+template<typename Key, typename Value, typename Storage>
+Value& CompactAVLTree<Key, Value, Storage>::operator[](const Key& key)
+{
+    uint32_t parentSlot;
+    bool leftSide;
+    uint32_t n = search(key, parentSlot, leftSide);
+    if(n == 0) throw std::out_of_range("Invalid key");
+    return at(n).item.second;
+}
+
+/*
+ * In-order successor of slot n (0 after the last).
+ */
+template<typename Key, typename Value, typename Storage>
+uint32_t CompactAVLTree<Key, Value, Storage>::successor(uint32_t n) const
+{
+    if(right(n) != 0)
+    {
+        n = right(n);
+        while(left(n) != 0)
+        {
+            n = left(n);
+        }
+        return n;
+    }
+    uint32_t p = parent(n);
+    while(p != 0 && right(p) == n)
+    {
+        n = p;
+        p = parent(p);
+    }
+    return p;
+}
+
+/*
+ * Points p's link to oldChild (or the root, when p is 0) at newChild.
+ */
+template<typename Key, typename Value, typename Storage>
+void CompactAVLTree<Key, Value, Storage>::replaceChild(uint32_t p, uint32_t oldChild, uint32_t newChild)
+{
+    if(p == 0)
+    {
+        header().root = newChild;
+    }
+    else if(left(p) == oldChild)
+    {
+        setLeft(p, newChild);
+    }
+    else
+    {
+        setRight(p, newChild);
+    }
+    if(newChild != 0)
+    {
+        setParent(newChild, p);
+    }
+}
+
+/*
+ * p's right child takes p's place. Balances are left to the caller.
+ */
+template<typename Key, typename Value, typename Storage>
+void CompactAVLTree<Key, Value, Storage>::rotateLeft(uint32_t p)
+{
+    uint32_t r = right(p);
+    uint32_t inner = left(r);
+    replaceChild(parent(p), p, r);
+    setRight(p, inner);
+    if(inner != 0)
+    {
+        setParent(inner, p);
+    }
+    setLeft(r, p);
+    setParent(p, r);
+}
+
+template<typename Key, typename Value, typename Storage>
+void CompactAVLTree<Key, Value, Storage>::rotateRight(uint32_t p)
+{
+    uint32_t l = left(p);
+    uint32_t inner = right(l);
+    replaceChild(parent(p), p, l);
+    setLeft(p, inner);
+    if(inner != 0)
+    {
+        setParent(inner, p);
+    }
+    setRight(l, p);
+    setParent(p, l);
+}
+
+/*
+ * Rotates g, whose s side (1: right, -1: left) has become two levels
+ * taller, and returns the change in the subtree's height (0 or -1). The
+ * packed bits cannot hold a balance of +-2, so g's stored balance is not
+ * read. Same relative-height bookkeeping as AVLTree::rebalance with a
+ * bound of 1.
+ */
+template<typename Key, typename Value, typename Storage>
+int CompactAVLTree<Key, Value, Storage>::rebalance(uint32_t g, int s)
+{
+    uint32_t c = s > 0 ? right(g) : left(g);
+
+    // h(c) = 0 in a frame mirrored so that the heavy side is the right
+    int hgL = -2;
+    int b = s * balance(c);
+    int hcR = b >= 0 ? -1 : -1 + b;
+    int hcL = b >= 0 ? -1 - b : -1;
+    int newHeight;
+
+    if(b >= 0)
+    {
+        BST_STAT(STAT_SINGLE_ROTATIONS, 1);
+        int hg = 1 + std::max(hgL, hcL);
+        if(s > 0)
+        {
+            rotateLeft(g);
+        }
+        else
+        {
+            rotateRight(g);
+        }
+        setBalance(g, s * (hcL - hgL));
+        setBalance(c, s * (hcR - hg));
+        newHeight = 1 + std::max(hg, hcR);
+    }
+    else
+    {
+        BST_STAT(STAT_DOUBLE_ROTATIONS, 1);
+        uint32_t d = s > 0 ? left(c) : right(c);
+        int e = s * balance(d);
+        int hdL = e >= 0 ? -2 - e : -2;
+        int hdR = e >= 0 ? -2 : -2 + e;
+        int hg = 1 + std::max(hgL, hdL);
+        int hc = 1 + std::max(hdR, hcR);
+        if(s > 0)
+        {
+            rotateRight(c);
+            rotateLeft(g);
+        }
+        else
+        {
+            rotateLeft(c);
+            rotateRight(g);
+        }
+        setBalance(g, s * (hdL - hgL));
+        setBalance(c, s * (hcR - hdR));
+        setBalance(d, s * (hc - hg));
+        newHeight = 1 + std::max(hg, hc);
+    }
+    return newHeight - 1;
+}
+
+template<typename Key, typename Value, typename Storage>
+void CompactAVLTree<Key, Value, Storage>::insert(const std::pair<const Key, Value>& item)
+{
+    BST_STAT(STAT_INSERTS, 1);
+    uint32_t p;
+    bool leftSide;
+    uint32_t found = search(item.first, p, leftSide);
+    if(found != 0)
+    {
+        // update value if already in tree
+        at(found).item.second = item.second;
+        return;
+    }
+
+    // allocate() may grow the array, so take no references across it
+    uint32_t n = allocate();
+    NodeType& node = at(n);
+    node.item = std::pair<Key, Value>(item.first, item.second);
+    node.left = 0;
+    node.right = 0;
+    node.parent = p;
+    if(p == 0)
+    {
+        header().root = n;
+        return;
+    }
+    if(leftSide)
+    {
+        setLeft(p, n);
+    }
+    else
+    {
+        setRight(p, n);
+    }
+    insert_fix(p, n);
+}
+
+/*
+ * Retraces after n, a child of p, grew by one level.
+ */
+template<typename Key, typename Value, typename Storage>
+void CompactAVLTree<Key, Value, Storage>::insert_fix(uint32_t p, uint32_t n)
+{
+    while(p != 0)
+    {
+        BST_STAT(STAT_REBALANCE_STEPS, 1);
+        int diff = left(p) == n ? -1 : 1;
+        int old = balance(p);
+        int now = old + diff;
+
+        // The shorter side caught up, so p's height did not change
+        if(old * diff < 0)
+        {
+            setBalance(p, now);
+            return;
+        }
+        if(now == 2 || now == -2)
+        {
+            if(rebalance(p, diff) < 0)
+            {
+                return;
+            }
+            p = parent(p);
+        }
+        else
+        {
+            setBalance(p, now);
+        }
+        n = p;
+        p = parent(p);
+    }
+}
+
+template<typename Key, typename Value, typename Storage>
+void CompactAVLTree<Key, Value, Storage>::remove(const Key& key)
+{
+    BST_STAT(STAT_REMOVES, 1);
+    uint32_t p;
+    bool leftSide;
+    uint32_t n = search(key, p, leftSide);
+    if(n == 0)
+    {
+        return;
+    }
+
+    // With two children, take the predecessor's item and remove its slot
+    if(left(n) != 0 && right(n) != 0)
+    {
+        uint32_t pred = left(n);
+        while(right(pred) != 0)
+        {
+            pred = right(pred);
+        }
+        std::swap(at(n).item, at(pred).item);
+        n = pred;
+    }
+
+    uint32_t child = left(n) != 0 ? left(n) : right(n);
+    p = parent(n);
+    int diff = 0;
+    if(p != 0)
+    {
+        diff = left(p) == n ? 1 : -1;
+    }
+    replaceChild(p, n, child);
+    release(n);
+    remove_fix(p, diff);
+}
+
+/*
+ * Retraces after n lost a level on one side (diff +1: left, -1: right).
+ */
+template<typename Key, typename Value, typename Storage>
+void CompactAVLTree<Key, Value, Storage>::remove_fix(uint32_t n, int diff)
+{
+    while(n != 0)
+    {
+        BST_STAT(STAT_REBALANCE_STEPS, 1);
+        uint32_t p = parent(n);
+        int ndiff = 0;
+        if(p != 0)
+        {
+            ndiff = left(p) == n ? 1 : -1;
+        }
+
+        int old = balance(n);
+        int now = old + diff;
+        if(old == 0)
+        {
+            setBalance(n, now);
+            return;
+        }
+        if(old * diff > 0)
+        {
+            if(rebalance(n, diff) == 0)
+            {
+                return;
+            }
+        }
+        else
+        {
+            setBalance(n, now);
+        }
+        n = p;
+        diff = ndiff;
+    }
+}
+
+/**
+ * Height of the tree, following the taller child down: O(log n).
+ */
+template<typename Key, typename Value, typename Storage>
+int CompactAVLTree<Key, Value, Storage>::height() const
+{
+    int h = 0;
+    for(uint32_t n = header().root; n != 0; n = balance(n) < 0 ? left(n) : right(n))
+    {
+        ++h;
+    }
+    return h;
+}
+
+template<typename Key, typename Value, typename Storage>
+ShapeReport CompactAVLTree<Key, Value, Storage>::shapeReport(unsigned threads) const
+{
+    const NodeType* root = header().root != 0 ? &at(header().root) : NULL;
+    return analyzeShape(root, CompactNodeChildren<NodeType>(storage_.nodes()), threads);
+}
+
+/**
+ * Checks links, balances and the AVL bound in one iterative pass.
+ */
+template<typename Key, typename Value, typename Storage>
+bool CompactAVLTree<Key, Value, Storage>::isBalanced() const
+{
+    std::vector<std::pair<uint32_t, bool> > stack;
+    std::vector<int> heights;
+    if(header().root != 0)
+    {
+        if(parent(header().root) != 0)
+        {
+            return false;
+        }
+        stack.push_back(std::make_pair(header().root, false));
+    }
+    while(!stack.empty())
+    {
+        uint32_t n = stack.back().first;
+        bool childrenDone = stack.back().second;
+        stack.pop_back();
+        if(!childrenDone)
+        {
+            stack.push_back(std::make_pair(n, true));
+            if(right(n) != 0)
+            {
+                if(parent(right(n)) != n)
+                {
+                    return false;
+                }
+                stack.push_back(std::make_pair(right(n), false));
+            }
+            if(left(n) != 0)
+            {
+                if(parent(left(n)) != n)
+                {
+                    return false;
+                }
+                stack.push_back(std::make_pair(left(n), false));
+            }
+            continue;
+        }
+        int rightH = 0;
+        int leftH = 0;
+        if(right(n) != 0)
+        {
+            rightH = heights.back();
+            heights.pop_back();
+        }
+        if(left(n) != 0)
+        {
+            leftH = heights.back();
+            heights.pop_back();
+        }
+        if(balance(n) != rightH - leftH || std::abs(rightH - leftH) > 1)
+        {
+            return false;
+        }
+        heights.push_back(1 + std::max(leftH, rightH));
+    }
+    return true;
+}
+
+/**
+ * Per-node layout plus live and peak counts. Nodes share one array, so
+ * there is no per-node allocator overhead; capacityBytes() gives the
+ * array's full size including unused slots.
+ */
+template<typename Key, typename Value, typename Storage>
+MemoryReport CompactAVLTree<Key, Value, Storage>::memoryReport() const
+{
+    MemoryReport report;
+    report.node.key = sizeof(Key);
+    report.node.value = sizeof(Value);
+    report.node.pointers = 3 * sizeof(uint32_t);
+    report.node.padding = sizeof(NodeType) - (report.node.key + report.node.value + report.node.pointers);
+    report.liveNodes = size();
+    report.peakNodes = header().peakNodes;
+    return report;
+}
+
+#endif
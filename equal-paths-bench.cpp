@@ -0,0 +1,77 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include "equal-paths.h"
+using namespace std;
+
+// Times equalPaths() on large trees of three shapes:
+//   perfect   all leaves on the last level (full scan, true)
+//   complete  n nodes filled level by level (leaves on two levels, false)
+//   chain     n nodes in a single right-leaning path (depth n, true)
+//
+//   equal-paths-bench [nodes]      (default 10000000)
+
+// Links nodes[0..n) as a complete tree in heap order.
+Node* buildComplete(vector<Node>& nodes, size_t n)
+{
+    nodes.clear();
+    nodes.reserve(n);
+    for(size_t i = 0; i < n; ++i)
+    {
+        nodes.push_back(Node((int)i));
+    }
+    for(size_t i = 0; i < n; ++i)
+    {
+        if(2 * i + 1 < n)
+        {
+            nodes[i].left = &nodes[2 * i + 1];
+        }
+        if(2 * i + 2 < n)
+        {
+            nodes[i].right = &nodes[2 * i + 2];
+        }
+    }
+    return n == 0 ? NULL : &nodes[0];
+}
+
+Node* buildChain(vector<Node>& nodes, size_t n)
+{
+    nodes.clear();
+    nodes.reserve(n);
+    for(size_t i = 0; i < n; ++i)
+    {
+        nodes.push_back(Node((int)i));
+    }
+    for(size_t i = 0; i + 1 < n; ++i)
+    {
+        nodes[i].right = &nodes[i + 1];
+    }
+    return n == 0 ? NULL : &nodes[0];
+}
+
+void timeIt(const char* shape, Node* root, size_t n)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    bool result = equalPaths(root);
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << shape << ": " << n << " nodes, equalPaths " << result << ", " << ms << " ms" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000;
+
+    // largest perfect tree that fits in n nodes
+    size_t perfect = 1;
+    while(perfect * 2 + 1 <= n)
+    {
+        perfect = perfect * 2 + 1;
+    }
+
+    vector<Node> nodes;
+    timeIt("perfect ", buildComplete(nodes, perfect), perfect);
+    timeIt("complete", buildComplete(nodes, n), n);
+    timeIt("chain   ", buildChain(nodes, n), n);
+    return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef EQUAL_PATHS_SHAPE_H
+#define EQUAL_PATHS_SHAPE_H
+
+#include "equal-paths.h"
+#include "shape-report.h"
+
+/**
+ * Child accessor for the plain Node trees of equal-paths.h, so they can
+ * use the same shape analysis as BinarySearchTree::shapeReport().
+ */
+struct EqualPathsChildren {
+    void operator()(Node* node, Node*& left, Node*& right) const
+    {
+        left = node->left;
+        right = node->right;
+    }
+};
+
+/**
+ * Single-pass shape report of a Node tree; report.equalLeafDepths()
+ * gives the same answer as equalPaths(root).
+ */
+inline ShapeReport shapeReport(Node* root, unsigned threads = 1)
+{
+    return analyzeShape(root, EqualPathsChildren(), threads);
+}
+
+#endif
@@ -1,6 +1,7 @@
 #include <iostream>
 #include <cstdlib>
 #include "equal-paths.h"
+#include "equal-paths-shape.h"
 using namespace std;
 
 
@@ -67,6 +68,9 @@ int main()
   test3("Test3");
   test4("Test4");
   test5("Test5");
+
+  cout << "Shape of Test5 tree:" << endl;
+  shapeReport(a).print(cout);
  
   delete a;
   delete b;
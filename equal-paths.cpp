@@ -1,71 +1,66 @@
+#include <utility>
+#include <vector>
 #include "equal-paths.h"
 using namespace std;
 
 
 // You may add any prototypes of helper functions here
-int depth(Node* node, int& value);
 
 
 bool equalPaths(Node * root)
 {
-    //Copy of the root
-    //used for traversal
-    Node* current = root;
-
     //If the tree is empty
-    if(current == NULL)
+    if(root == NULL)
     {
         return true;
     }
 
-    //Value to hold 0
-    int zero = 0;
+    //Nodes still to visit together with their distance from the root.
+    //An explicit stack keeps very deep trees off the call stack.
+    vector<pair<Node*, int> > stack;
+    stack.push_back(make_pair(root, 0));
 
-    //Getting the ints for both sides of the tree
-    int lheight = depth(current->left, zero);
-    int rheight = depth(current->right, zero);
+    //Depth of the first leaf we find; every other leaf must match it
+    int leafDepth = -1;
 
-    //Checking to make sure they are balanced
-    //If not then the tree is not balanced and will return false
-    if(abs(lheight- rheight) == 0)
+    while(!stack.empty())
     {
-        if(equalPaths(current->left) == true && equalPaths(current->right) == true)
+        Node* current = stack.back().first;
+        int depth = stack.back().second;
+        stack.pop_back();
+
+        //A leaf: compare against the first leaf and stop at the
+        //first mismatch
+        if(current->left == NULL && current->right == NULL)
         {
-            return true;
+            if(leafDepth == -1)
+            {
+                leafDepth = depth;
+            }
+            else if(depth != leafDepth)
+            {
+                return false;
+            }
+            continue;
         }
-    }
-
-    //Not balanced so return false
-    return false;
-}
 
-int depth(Node* node, int& value)
-{
-    //Value to hold the return count
-    value++;
+        //Once a leaf depth is known, any node at or below it that
+        //still has children must lead to a deeper leaf
+        if(leafDepth != -1 && depth >= leafDepth)
+        {
+            return false;
+        }
 
-    //Base case for recursion
-    if (node == NULL)
-    {
-        return 0;
-    }
-    
-    //If the left side of the tree is 
-    //heavier than the right side
-    if(depth(node->left, value) > depth(node->right, value) )
-    {
-        value = depth(node->left, value);
-        return value + 1;
-    }
-    //If the right side of the tree is 
-    //heavier than the left side
-    else if(depth(node->left, value) < depth(node->right, value))
-    {
-        value = depth(node->right, value);
-        return value + 1;
+        if(current->right != NULL)
+        {
+            stack.push_back(make_pair(current->right, depth + 1));
+        }
+        if(current->left != NULL)
+        {
+            stack.push_back(make_pair(current->left, depth + 1));
+        }
     }
 
-    //If they are equal then this return value will happen
-    return 0;
+    //Every leaf was at the same depth
+    return true;
 }
-
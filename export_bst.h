@@ -0,0 +1,296 @@
+#ifndef EXPORT_BST_H
+#define EXPORT_BST_H
+
+#include <cmath>
+#include <limits>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// BST export to Graphviz DOT or JSON.
+//
+// Unlike printRoot() this writes the whole tree (or as much as the
+// ExportOptions allow) in a single iterative pre-order pass: no
+// recursion, no per-node maps, and output is collected in a buffer
+// that is handed to the stream in large blocks.
+//
+// Tombstones left by lazy deletion still hold the tree together, so
+// they are written but marked: dashed in DOT, "deleted":true in JSON.
+// The JSON "size" counts live keys only, like size().
+
+// flush the buffer to the stream once it grows past this many bytes
+#define EXPORT_BUFFER_BYTES (64 * 1024)
+
+// Appends a key or value to the buffer. Integers go through
+// std::to_string, floating-point numbers are written with enough digits
+// to read back the same value, bools as true/false and everything else
+// through operator<<.
+template<typename T>
+void exportAppendRaw(std::string& buffer, std::ostringstream& scratch, const T& item,
+                     typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, char>::value
+                                             && !std::is_same<T, bool>::value>::type* = 0)
+{
+    buffer += std::to_string(item);
+}
+
+template<typename T>
+void exportAppendRaw(std::string& buffer, std::ostringstream& scratch, const T& item,
+                     typename std::enable_if<std::is_floating_point<T>::value>::type* = 0)
+{
+    std::streamsize precision = scratch.precision(std::numeric_limits<T>::max_digits10);
+    scratch.str(std::string());
+    scratch << item;
+    scratch.precision(precision);
+    buffer += scratch.str();
+}
+
+template<typename T>
+void exportAppendRaw(std::string& buffer, std::ostringstream& scratch, const T& item,
+                     typename std::enable_if<std::is_same<T, bool>::value>::type* = 0)
+{
+    buffer += item ? "true" : "false";
+}
+
+template<typename T>
+void exportAppendRaw(std::string& buffer, std::ostringstream& scratch, const T& item,
+                     typename std::enable_if<!std::is_arithmetic<T>::value || std::is_same<T, char>::value>::type* = 0)
+{
+    scratch.str(std::string());
+    scratch << item;
+    buffer += scratch.str();
+}
+
+// Appends a quoted string for DOT labels (json false) or JSON strings.
+// Quotes and backslashes are escaped in both. JSON also gets the other
+// control characters escaped, so keys read back unchanged; DOT only
+// needs newlines escaped and takes the rest as they are.
+template<typename T>
+void exportAppendQuoted(std::string& buffer, std::ostringstream& scratch, const T& item, bool json)
+{
+    static const char HEX[] = "0123456789abcdef";
+    std::string text;
+    exportAppendRaw(text, scratch, item);
+    buffer += '"';
+    for(size_t i = 0; i < text.size(); ++i)
+    {
+        char c = text[i];
+        if(c == '"' || c == '\\')
+        {
+            buffer += '\\';
+            buffer += c;
+        }
+        else if(c == '\n')
+        {
+            buffer += "\\n";
+        }
+        else if(!json || (unsigned char)c >= 0x20)
+        {
+            buffer += c;
+        }
+        else if(c == '\t')
+        {
+            buffer += "\\t";
+        }
+        else if(c == '\r')
+        {
+            buffer += "\\r";
+        }
+        else
+        {
+            buffer += "\\u00";
+            buffer += HEX[(unsigned char)c >> 4];
+            buffer += HEX[c & 0xf];
+        }
+    }
+    buffer += '"';
+}
+
+// JSON numbers and bools are written bare, everything else as a string.
+// NaN and infinities have no JSON form and become null.
+template<typename T>
+void exportAppendJson(std::string& buffer, std::ostringstream& scratch, const T& item,
+                      typename std::enable_if<std::is_arithmetic<T>::value && !std::is_same<T, char>::value>::type* = 0)
+{
+    if(std::is_floating_point<T>::value && !std::isfinite((long double)item))
+    {
+        buffer += "null";
+        return;
+    }
+    exportAppendRaw(buffer, scratch, item);
+}
+
+template<typename T>
+void exportAppendJson(std::string& buffer, std::ostringstream& scratch, const T& item,
+                      typename std::enable_if<!std::is_arithmetic<T>::value || std::is_same<T, char>::value>::type* = 0)
+{
+    exportAppendQuoted(buffer, scratch, item, true);
+}
+
+/**
+ * Writes the whole tree. See ExportOptions for depth and node limits.
+ */
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::exportTree(std::ostream& out, TreeExportFormat format,
+                                              const ExportOptions& options) const
+{
+    exportRoot(root_, out, format, options);
+}
+
+/**
+ * Writes only the subtree rooted at the node holding key. Returns false
+ * (and writes nothing) if the key is not in the tree or was deleted.
+ */
+template<typename Key, typename Value>
+bool BinarySearchTree<Key, Value>::exportSubtree(const Key& key, std::ostream& out, TreeExportFormat format,
+                                                 const ExportOptions& options) const
+{
+    Node<Key, Value>* node = internalFind(key);
+    if(node == nullptr || node->isTombstone())
+    {
+        return false;
+    }
+    exportRoot(node, out, format, options);
+    return true;
+}
+
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::exportRoot(Node<Key, Value>* root, std::ostream& out, TreeExportFormat format,
+                                              const ExportOptions& options) const
+{
+    // One pending piece of work. A NULL token means "visit node".
+    struct Frame {
+        Node<Key, Value>* node;
+        int depth;
+        size_t parentId;
+        char side;
+        const char* token;
+    };
+
+    std::string buffer;
+    buffer.reserve(EXPORT_BUFFER_BYTES + 4096);
+    std::ostringstream scratch;
+    std::vector<Frame> stack;
+    size_t nextId = 0;
+    size_t written = 0;
+
+    if(format == EXPORT_DOT)
+    {
+        buffer += "digraph BST {\n  node [shape=box, fontname=\"monospace\"];\n";
+    }
+    else
+    {
+        buffer += "{";
+        if(root == root_)
+        {
+            buffer += "\"size\":";
+            buffer += std::to_string(size());
+            buffer += ",";
+        }
+        buffer += "\"root\":";
+    }
+
+    Frame first = { root, 1, 0, ' ', NULL };
+    stack.push_back(first);
+
+    while(!stack.empty())
+    {
+        Frame frame = stack.back();
+        stack.pop_back();
+
+        if(frame.token != NULL)
+        {
+            buffer += frame.token;
+        }
+        else if(format == EXPORT_DOT)
+        {
+            // DOT: skip empty children; edges point from the parent's id
+            if(frame.node == nullptr)
+            {
+                continue;
+            }
+            size_t id = nextId++;
+            bool truncated = (options.maxDepth >= 0 && frame.depth > options.maxDepth)
+                             || (options.maxNodes != 0 && written >= options.maxNodes);
+            buffer += "  n";
+            buffer += std::to_string(id);
+            if(truncated)
+            {
+                buffer += " [label=\"...\", shape=plaintext];\n";
+            }
+            else
+            {
+                ++written;
+                std::string label;
+                exportAppendRaw(label, scratch, frame.node->getKey());
+                label += ": ";
+                exportAppendRaw(label, scratch, frame.node->getValue());
+                buffer += " [label=";
+                exportAppendQuoted(buffer, scratch, label, false);
+                buffer += frame.node->isTombstone() ? ", style=dashed];\n" : "];\n";
+            }
+            if(frame.depth > 1)
+            {
+                buffer += "  n";
+                buffer += std::to_string(frame.parentId);
+                buffer += " -> n";
+                buffer += std::to_string(id);
+                buffer += frame.side == 'L' ? " [label=\"L\"];\n" : " [label=\"R\"];\n";
+            }
+            if(!truncated)
+            {
+                Frame right = { frame.node->getRight(), frame.depth + 1, id, 'R', NULL };
+                Frame left = { frame.node->getLeft(), frame.depth + 1, id, 'L', NULL };
+                stack.push_back(right);
+                stack.push_back(left);
+            }
+        }
+        else
+        {
+            // JSON: nested objects, closed by tokens queued below the children
+            if(frame.node == nullptr)
+            {
+                buffer += "null";
+            }
+            else if((options.maxDepth >= 0 && frame.depth > options.maxDepth)
+                    || (options.maxNodes != 0 && written >= options.maxNodes))
+            {
+                buffer += "{\"truncated\":true}";
+            }
+            else
+            {
+                ++written;
+                buffer += "{\"key\":";
+                exportAppendJson(buffer, scratch, frame.node->getKey());
+                buffer += ",\"value\":";
+                exportAppendJson(buffer, scratch, frame.node->getValue());
+                if(frame.node->isTombstone())
+                {
+                    buffer += ",\"deleted\":true";
+                }
+                buffer += ",\"left\":";
+                Frame close = { nullptr, 0, 0, ' ', "}" };
+                Frame right = { frame.node->getRight(), frame.depth + 1, 0, 'R', NULL };
+                Frame sep = { nullptr, 0, 0, ' ', ",\"right\":" };
+                Frame left = { frame.node->getLeft(), frame.depth + 1, 0, 'L', NULL };
+                stack.push_back(close);
+                stack.push_back(right);
+                stack.push_back(sep);
+                stack.push_back(left);
+            }
+        }
+
+        if(buffer.size() >= EXPORT_BUFFER_BYTES)
+        {
+            out.write(buffer.data(), (std::streamsize)buffer.size());
+            buffer.clear();
+        }
+    }
+
+    buffer += "}\n";
+    out.write(buffer.data(), (std::streamsize)buffer.size());
+    out.flush();
+}
+
+#endif
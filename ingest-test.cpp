@@ -0,0 +1,78 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "bst.h"
+#include "avlbst.h"
+#include "ingest.h"
+
+using namespace std;
+
+void printTree(const char* msg, BinarySearchTree<int, string>& tree)
+{
+    cout << msg << ":";
+    for(BinarySearchTree<int, string>::iterator it = tree.begin(); it != tree.end(); ++it)
+    {
+        cout << " " << it->first << "=" << it->second;
+    }
+    cout << endl;
+}
+
+void putLength(string& out, uint32_t len)
+{
+    for(int i = 0; i < 4; ++i)
+    {
+        out.push_back((char)((len >> (8 * i)) & 0xff));
+    }
+}
+
+int main()
+{
+    IngestOptions opts;
+    opts.batchSize = 3;
+    opts.queueDepth = 1;
+
+    // TSV into a BST, with a duplicate key, a CRLF line and a bad line
+    istringstream tsv("5\tfive\n3\tthree\n8\teight\r\nbogus line\n1\tone\n5\tFIVE\n9\tnine");
+    BinarySearchTree<int, string> bt;
+    IngestStats s1 = ingest(tsv, bt, opts);
+    printTree("TSV BST", bt);
+    cout << "records: " << s1.records << " malformed: " << s1.malformed << endl;
+
+    // Binary records into an AVL tree
+    string bin;
+    for(int i = 10; i > 0; --i)
+    {
+        string key = to_string(i);
+        string value(i, 'x');
+        putLength(bin, (uint32_t)key.size());
+        bin += key;
+        putLength(bin, (uint32_t)value.size());
+        bin += value;
+    }
+    istringstream binIn(bin);
+    opts.format = INGEST_BINARY;
+    opts.readBufferSize = 7; // force records to straddle reads
+    AVLTree<int, string> at;
+    IngestStats s2 = ingest(binIn, at, opts);
+    printTree("Binary AVL", at);
+    cout << "records: " << s2.records << " malformed: " << s2.malformed << " bytes: " << s2.bytes << endl;
+
+    // Pipelined load: later batches overwrite earlier ones in input order
+    // even though several threads parse them
+    string lines;
+    for(int i = 0; i < 40; ++i)
+    {
+        lines += to_string(i % 12) + "\tv" + to_string(i) + "\n";
+    }
+    lines += "oops\n";
+    istringstream asyncIn(lines);
+    opts.format = INGEST_TSV;
+    opts.parseThreads = 3;
+    AVLTree<int, string> pt;
+    shared_future<IngestStats> ready = ingestAsync(asyncIn, pt, opts);
+    IngestStats s3 = ready.get();
+    printTree("Async AVL", pt);
+    cout << "records: " << s3.records << " malformed: " << s3.malformed << " balanced: " << pt.isBalanced() << endl;
+
+    return 0;
+}
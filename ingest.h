@@ -0,0 +1,615 @@
+#ifndef INGEST_H
+#define INGEST_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <sys/resource.h>
+#include "bst.h"
+
+/**
+ * Streaming loader for key/value records.
+ *
+ * Records are read from any std::istream (a file, std::cin, a pipe) in
+ * large chunks, parsed on a separate thread and handed over in batches
+ * through a bounded queue, so a slow tree never lets the parser run away
+ * with memory. The inserting thread sorts each batch and feeds it to
+ * the tree median-first, which keeps a plain BinarySearchTree from
+ * degenerating on sorted input and saves the AVLTree rotations.
+ *
+ * ingestAsync() runs the same load as a pipeline in the background:
+ * reading, parsing and sorting batches on several threads while the
+ * tree is built, and returns a future that is ready with the tree.
+ *
+ * Supported formats:
+ *   INGEST_TSV     one "key<TAB>value" record per line ('\r\n' accepted)
+ *   INGEST_BINARY  repeated [uint32 keyLen][key][uint32 valueLen][value],
+ *                  lengths little-endian
+ */
+enum IngestFormat { INGEST_TSV, INGEST_BINARY };
+
+struct IngestOptions {
+    IngestFormat format;
+    size_t readBufferSize;  // bytes requested from the stream per read
+    size_t batchSize;       // records handed from the parser to the inserter at once
+    size_t queueDepth;      // parsed batches allowed in flight before the parser blocks
+    unsigned parseThreads;  // ingestAsync(): threads converting and sorting batches
+
+    IngestOptions() :
+        format(INGEST_TSV), readBufferSize(1 << 20), batchSize(4096), queueDepth(8), parseThreads(2)
+    {}
+};
+
+struct IngestStats {
+    size_t records;    // records inserted (duplicates included)
+    size_t malformed;  // lines/records that could not be parsed
+    size_t bytes;      // bytes consumed from the stream
+    double seconds;    // wall time from first read to last insert
+    long peakRssKb;    // peak resident set size of the process
+
+    IngestStats() : records(0), malformed(0), bytes(0), seconds(0.0), peakRssKb(0) {}
+
+    double recordsPerSecond() const { return seconds > 0.0 ? records / seconds : 0.0; }
+
+    void print(std::ostream& out) const
+    {
+        out << "records:     " << records << "\n"
+            << "malformed:   " << malformed << "\n"
+            << "bytes:       " << bytes << "\n"
+            << "seconds:     " << seconds << "\n"
+            << "records/sec: " << (size_t)recordsPerSecond() << "\n"
+            << "peak RSS:    " << peakRssKb << " KB" << std::endl;
+    }
+};
+
+/**
+ * Peak resident set size of this process in kilobytes (0 if unknown).
+ */
+inline long peakRssKb()
+{
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0;
+    }
+    return usage.ru_maxrss;
+}
+
+/**
+ * A fixed-capacity blocking queue. push() blocks while the queue is
+ * full (backpressure), pop() blocks while it is empty and returns false
+ * once the queue has been closed and drained.
+ */
+template<typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity) : capacity_(capacity == 0 ? 1 : capacity), closed_(false) {}
+
+    void push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notFull_.wait(lock, [this] { return items_.size() < capacity_ || closed_; });
+        if(closed_)
+        {
+            return;
+        }
+        items_.push_back(std::move(item));
+        notEmpty_.notify_one();
+    }
+
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notEmpty_.wait(lock, [this] { return !items_.empty() || closed_; });
+        if(items_.empty())
+        {
+            return false;
+        }
+        item = std::move(items_.front());
+        items_.pop_front();
+        notFull_.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        notEmpty_.notify_all();
+        notFull_.notify_all();
+    }
+
+private:
+    size_t capacity_;
+    bool closed_;
+    std::deque<T> items_;
+    std::mutex mutex_;
+    std::condition_variable notEmpty_;
+    std::condition_variable notFull_;
+};
+
+/**
+ * Splits a stream into raw key/value fields using large buffered reads.
+ */
+class RecordReader
+{
+public:
+    RecordReader(std::istream& in, IngestFormat format, size_t bufferSize) :
+        in_(in), format_(format), buffer_(bufferSize == 0 ? 1 : bufferSize), begin_(0), end_(0), eof_(false),
+        bytes_(0), malformed_(0)
+    {}
+
+    /**
+     * Reads the next record. Returns false at end of input.
+     */
+    bool next(std::string& key, std::string& value)
+    {
+        if(format_ == INGEST_BINARY)
+        {
+            return nextBinary(key, value);
+        }
+        return nextLine(key, value);
+    }
+
+    size_t bytes() const { return bytes_; }
+    size_t malformed() const { return malformed_; }
+
+private:
+    // Refills the buffer, keeping the unconsumed tail. Returns false
+    // if no more bytes could be read.
+    bool fill()
+    {
+        if(eof_)
+        {
+            return false;
+        }
+        if(begin_ > 0)
+        {
+            std::memmove(&buffer_[0], &buffer_[begin_], end_ - begin_);
+            end_ -= begin_;
+            begin_ = 0;
+        }
+        if(end_ == buffer_.size())
+        {
+            // a single record is larger than the buffer
+            buffer_.resize(buffer_.size() * 2);
+        }
+        std::streamsize got = in_.rdbuf()->sgetn(&buffer_[end_], buffer_.size() - end_);
+        if(got <= 0)
+        {
+            eof_ = true;
+            return false;
+        }
+        end_ += (size_t)got;
+        bytes_ += (size_t)got;
+        return true;
+    }
+
+    bool nextLine(std::string& key, std::string& value)
+    {
+        while(true)
+        {
+            const char* start = &buffer_[0] + begin_;
+            const char* nl = (const char*)std::memchr(start, '\n', end_ - begin_);
+            size_t len;
+            if(nl != NULL)
+            {
+                len = (size_t)(nl - start);
+            }
+            else if(fill())
+            {
+                continue;
+            }
+            else if(begin_ < end_)
+            {
+                // final line without a newline
+                start = &buffer_[0] + begin_;
+                len = end_ - begin_;
+            }
+            else
+            {
+                return false;
+            }
+
+            size_t consumed = len + (nl != NULL ? 1 : 0);
+            if(len > 0 && start[len - 1] == '\r')
+            {
+                --len;
+            }
+            const char* tab = (const char*)std::memchr(start, '\t', len);
+            begin_ += consumed;
+            if(len == 0)
+            {
+                continue;
+            }
+            if(tab == NULL)
+            {
+                ++malformed_;
+                continue;
+            }
+            key.assign(start, (size_t)(tab - start));
+            value.assign(tab + 1, (size_t)(start + len - tab - 1));
+            return true;
+        }
+    }
+
+    // Makes sure at least n unconsumed bytes are buffered.
+    bool require(size_t n)
+    {
+        while(end_ - begin_ < n)
+        {
+            if(!fill())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    uint32_t readLength()
+    {
+        const unsigned char* p = (const unsigned char*)&buffer_[begin_];
+        begin_ += 4;
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    bool nextBinary(std::string& key, std::string& value)
+    {
+        if(!require(4))
+        {
+            if(begin_ < end_)
+            {
+                // truncated trailing record
+                ++malformed_;
+                begin_ = end_;
+            }
+            return false;
+        }
+        uint32_t keyLen = readLength();
+        if(!require((size_t)keyLen + 4))
+        {
+            ++malformed_;
+            begin_ = end_;
+            return false;
+        }
+        key.assign(&buffer_[begin_], keyLen);
+        begin_ += keyLen;
+        uint32_t valueLen = readLength();
+        if(!require(valueLen))
+        {
+            ++malformed_;
+            begin_ = end_;
+            return false;
+        }
+        value.assign(&buffer_[begin_], valueLen);
+        begin_ += valueLen;
+        return true;
+    }
+
+    std::istream& in_;
+    IngestFormat format_;
+    std::vector<char> buffer_;
+    size_t begin_;
+    size_t end_;
+    bool eof_;
+    size_t bytes_;
+    size_t malformed_;
+};
+
+/**
+ * Converts a raw field into the tree's key or value type. Strings are
+ * taken verbatim; everything else goes through operator>>.
+ */
+template<typename T>
+bool convertField(const std::string& field, T& out)
+{
+    std::istringstream ss(field);
+    ss >> out;
+    return !ss.fail();
+}
+
+inline bool convertField(const std::string& field, std::string& out)
+{
+    out = field;
+    return true;
+}
+
+/**
+ * Inserts a sorted, duplicate-free batch median-first so that every
+ * batch lands in the tree as a balanced subtree shape.
+ */
+template<typename Key, typename Value>
+void insertSortedBatch(BinarySearchTree<Key, Value>& tree, const std::vector<std::pair<Key, Value> >& batch)
+{
+    std::vector<std::pair<size_t, size_t> > ranges;
+    if(!batch.empty())
+    {
+        ranges.push_back(std::make_pair((size_t)0, batch.size()));
+    }
+    while(!ranges.empty())
+    {
+        size_t lo = ranges.back().first;
+        size_t hi = ranges.back().second;
+        ranges.pop_back();
+        size_t mid = lo + (hi - lo) / 2;
+        tree.insert(std::pair<const Key, Value>(batch[mid].first, batch[mid].second));
+        if(mid + 1 < hi)
+        {
+            ranges.push_back(std::make_pair(mid + 1, hi));
+        }
+        if(lo < mid)
+        {
+            ranges.push_back(std::make_pair(lo, mid));
+        }
+    }
+}
+
+/**
+ * Sorts a batch by key and keeps only the last record for each key, so
+ * the result matches inserting the batch in arrival order.
+ */
+template<typename Key, typename Value>
+void sortBatch(std::vector<std::pair<Key, Value> >& batch)
+{
+    std::stable_sort(batch.begin(), batch.end(),
+                     [](const std::pair<Key, Value>& a, const std::pair<Key, Value>& b) { return a.first < b.first; });
+    size_t out = 0;
+    for(size_t i = 0; i < batch.size(); ++i)
+    {
+        if(i + 1 < batch.size() && !(batch[i].first < batch[i + 1].first))
+        {
+            continue;
+        }
+        if(out != i)
+        {
+            batch[out] = std::move(batch[i]);
+        }
+        ++out;
+    }
+    batch.resize(out);
+}
+
+/**
+ * Streams every record from `in` into `tree`. Parsing runs on its own
+ * thread; insertion happens on the calling thread. An exception from the
+ * tree stops the parser and is rethrown once it has exited.
+ */
+template<typename Key, typename Value>
+IngestStats ingest(std::istream& in, BinarySearchTree<Key, Value>& tree, const IngestOptions& opts = IngestOptions())
+{
+    typedef std::vector<std::pair<Key, Value> > Batch;
+
+    IngestStats stats;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    BoundedQueue<Batch> queue(opts.queueDepth);
+    RecordReader reader(in, opts.format, opts.readBufferSize);
+    size_t badFields = 0;
+
+    std::thread parser([&]() {
+        std::string rawKey;
+        std::string rawValue;
+        Batch batch;
+        batch.reserve(opts.batchSize);
+        while(reader.next(rawKey, rawValue))
+        {
+            std::pair<Key, Value> record;
+            if(!convertField(rawKey, record.first) || !convertField(rawValue, record.second))
+            {
+                ++badFields;
+                continue;
+            }
+            batch.push_back(std::move(record));
+            if(batch.size() >= opts.batchSize)
+            {
+                queue.push(std::move(batch));
+                batch = Batch();
+                batch.reserve(opts.batchSize);
+            }
+        }
+        if(!batch.empty())
+        {
+            queue.push(std::move(batch));
+        }
+        queue.close();
+    });
+
+    Batch batch;
+    try
+    {
+        while(queue.pop(batch))
+        {
+            stats.records += batch.size();
+            sortBatch(batch);
+            insertSortedBatch(tree, batch);
+        }
+    }
+    catch(...)
+    {
+        // The parser may be blocked on a full queue; release it so the
+        // thread can be joined before the exception leaves
+        queue.close();
+        parser.join();
+        throw;
+    }
+    parser.join();
+
+    stats.bytes = reader.bytes();
+    stats.malformed = reader.malformed() + badFields;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    stats.peakRssKb = peakRssKb();
+    return stats;
+}
+
+/**
+ * Loads every record from `in` into `tree` in the background and
+ * returns a future that becomes ready, with the load's statistics, once
+ * the tree is complete. Any number of threads can wait on it and then
+ * query the tree; until then neither `in` nor `tree` may be touched.
+ *
+ * The load is a pipeline with bounded queues between the stages: one
+ * thread reads and splits records, opts.parseThreads threads convert
+ * and sort batches, and the task's own thread inserts the sorted
+ * batches in input order, so the result is the same as ingest(). A
+ * parse thread does not start a batch more than opts.queueDepth ahead
+ * of the next one to insert, so a slow batch cannot let the others
+ * pile up behind it.
+ * Exceptions from the tree (e.g. bad_alloc) are rethrown by get().
+ */
+template<typename Key, typename Value>
+std::shared_future<IngestStats> ingestAsync(std::istream& in, BinarySearchTree<Key, Value>& tree,
+                                            const IngestOptions& opts = IngestOptions())
+{
+    return std::async(std::launch::async, [&in, &tree, opts]() {
+        typedef std::vector<std::pair<std::string, std::string> > RawBatch;
+        typedef std::vector<std::pair<Key, Value> > Batch;
+        // Batches carry their position in the input so the inserter can
+        // restore the order the parse threads finished them out of.
+        struct Numbered {
+            size_t index;
+            size_t records;
+            Batch items;
+        };
+
+        IngestStats stats;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        RecordReader reader(in, opts.format, opts.readBufferSize);
+        BoundedQueue<std::pair<size_t, RawBatch> > raw(opts.queueDepth);
+        BoundedQueue<Numbered> sorted(opts.queueDepth);
+        std::atomic<size_t> badFields(0);
+        unsigned parseThreads = opts.parseThreads == 0 ? 1 : opts.parseThreads;
+        std::atomic<unsigned> parsersLeft(parseThreads);
+
+        // Index of the next batch to insert; parse threads wait on it
+        size_t window = opts.queueDepth == 0 ? 1 : opts.queueDepth;
+        size_t next = 0;
+        bool stopping = false;
+        std::mutex orderMutex;
+        std::condition_variable nextChanged;
+
+        std::thread splitter([&]() {
+            std::string rawKey;
+            std::string rawValue;
+            RawBatch batch;
+            size_t index = 0;
+            while(reader.next(rawKey, rawValue))
+            {
+                batch.push_back(std::make_pair(rawKey, rawValue));
+                if(batch.size() >= opts.batchSize)
+                {
+                    raw.push(std::make_pair(index++, std::move(batch)));
+                    batch = RawBatch();
+                }
+            }
+            if(!batch.empty())
+            {
+                raw.push(std::make_pair(index, std::move(batch)));
+            }
+            raw.close();
+        });
+
+        std::vector<std::thread> parsers;
+        for(unsigned t = 0; t < parseThreads; ++t)
+        {
+            parsers.push_back(std::thread([&]() {
+                std::pair<size_t, RawBatch> job;
+                while(raw.pop(job))
+                {
+                    {
+                        std::unique_lock<std::mutex> lock(orderMutex);
+                        nextChanged.wait(lock, [&] { return job.first < next + window || stopping; });
+                        if(stopping)
+                        {
+                            break;
+                        }
+                    }
+                    Numbered out;
+                    out.index = job.first;
+                    out.items.reserve(job.second.size());
+                    for(size_t i = 0; i < job.second.size(); ++i)
+                    {
+                        std::pair<Key, Value> record;
+                        if(!convertField(job.second[i].first, record.first) ||
+                           !convertField(job.second[i].second, record.second))
+                        {
+                            ++badFields;
+                            continue;
+                        }
+                        out.items.push_back(std::move(record));
+                    }
+                    out.records = out.items.size();
+                    sortBatch(out.items);
+                    sorted.push(std::move(out));
+                }
+                if(--parsersLeft == 0)
+                {
+                    sorted.close();
+                }
+            }));
+        }
+
+        std::exception_ptr failure;
+        try
+        {
+            std::map<size_t, Numbered> early;
+            Numbered batch;
+            while(sorted.pop(batch))
+            {
+                early[batch.index] = std::move(batch);
+                typename std::map<size_t, Numbered>::iterator it;
+                while((it = early.find(next)) != early.end())
+                {
+                    stats.records += it->second.records;
+                    insertSortedBatch(tree, it->second.items);
+                    early.erase(it);
+                    std::lock_guard<std::mutex> lock(orderMutex);
+                    ++next;
+                    nextChanged.notify_all();
+                }
+            }
+        }
+        catch(...)
+        {
+            // Unblock the other stages so they can be joined
+            failure = std::current_exception();
+            {
+                std::lock_guard<std::mutex> lock(orderMutex);
+                stopping = true;
+                nextChanged.notify_all();
+            }
+            raw.close();
+            sorted.close();
+        }
+        splitter.join();
+        for(size_t t = 0; t < parsers.size(); ++t)
+        {
+            parsers[t].join();
+        }
+        if(failure)
+        {
+            std::rethrow_exception(failure);
+        }
+
+        stats.bytes = reader.bytes();
+        stats.malformed = reader.malformed() + badFields;
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats.peakRssKb = peakRssKb();
+        return stats;
+    }).share();
+}
+
+#endif
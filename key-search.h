@@ -0,0 +1,117 @@
+#ifndef KEY_SEARCH_H
+#define KEY_SEARCH_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+/**
+ * Comparison state for one root-to-leaf descent. compare() returns
+ * -1, 0 or 1 as the searched key is less than, equal to or greater than
+ * the key of the next node on the path.
+ *
+ * Generic keys just use operator< and operator>. String-like keys
+ * specialize this to skip bytes already known to match, see below.
+ */
+template<typename Key>
+class KeySearch
+{
+public:
+    explicit KeySearch(const Key& key) : key_(key) {}
+
+    int compare(const Key& nodeKey)
+    {
+        if(key_ < nodeKey)
+        {
+            return -1;
+        }
+        return key_ > nodeKey ? 1 : 0;
+    }
+
+private:
+    const Key& key_;
+};
+
+/**
+ * Byte-wise three-way comparison of a and b that trusts their first
+ * `skip` bytes to be equal. Stores the length of their common prefix in
+ * lcp. Orders like std::string (unsigned bytes, then length).
+ */
+inline int prefixCompare(const char* a, size_t aLength, const char* b, size_t bLength, size_t skip, size_t& lcp)
+{
+    size_t shorter = std::min(aLength, bLength);
+    size_t i = skip;
+
+    // Skip equal 8-byte words, then find the differing byte
+    while(i + sizeof(uint64_t) <= shorter)
+    {
+        uint64_t x;
+        uint64_t y;
+        std::memcpy(&x, a + i, sizeof(x));
+        std::memcpy(&y, b + i, sizeof(y));
+        if(x != y)
+        {
+            break;
+        }
+        i += sizeof(uint64_t);
+    }
+    while(i < shorter && a[i] == b[i])
+    {
+        ++i;
+    }
+    lcp = i;
+    if(i < shorter)
+    {
+        return (unsigned char)a[i] < (unsigned char)b[i] ? -1 : 1;
+    }
+    return aLength < bLength ? -1 : (aLength > bLength ? 1 : 0);
+}
+
+/**
+ * Descent over string-like keys that skips already-matched prefixes.
+ * Every key in the current subtree lies between the closest ancestors
+ * passed on the left and on the right, so it shares at least
+ * min(lcp with the lower bound, lcp with the upper bound) bytes with the
+ * searched key. With long shared prefixes (URLs, paths) each comparison
+ * then only scans the bytes that still differ.
+ *
+ * Key needs data() and size(), like std::string.
+ */
+template<typename Key>
+class PrefixKeySearch
+{
+public:
+    explicit PrefixKeySearch(const Key& key) : key_(key), lowLcp_(0), highLcp_(0) {}
+
+    int compare(const Key& nodeKey)
+    {
+        size_t lcp;
+        int result = prefixCompare(key_.data(), key_.size(), nodeKey.data(), nodeKey.size(),
+                                   std::min(lowLcp_, highLcp_), lcp);
+        if(result < 0)
+        {
+            highLcp_ = lcp;
+        }
+        else if(result > 0)
+        {
+            lowLcp_ = lcp;
+        }
+        return result;
+    }
+
+private:
+    const Key& key_;
+    size_t lowLcp_;   // common prefix with the closest smaller ancestor
+    size_t highLcp_;  // common prefix with the closest larger ancestor
+};
+
+template<>
+class KeySearch<std::string> : public PrefixKeySearch<std::string>
+{
+public:
+    explicit KeySearch(const std::string& key) : PrefixKeySearch<std::string>(key) {}
+};
+
+#endif
@@ -0,0 +1,334 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * A log-linear latency histogram in the style of HdrHistogram.
+ *
+ * Values (nanoseconds) below 2^SUB_BITS get their own bucket. Above
+ * that, every power of two is split into 2^SUB_BITS equal sub-buckets,
+ * so any recorded value is reported within about 3% of its true value
+ * while the whole 64-bit range fits in a fixed array. Recording is an
+ * index computation and one increment; histograms from different
+ * threads are combined with merge().
+ *
+ * Only one thread may record into a histogram, but other threads can
+ * read or merge it at the same time: the fields are relaxed atomics
+ * that the recording thread updates with plain loads and stores, as in
+ * ThreadTreeStats.
+ */
+class LatencyHistogram
+{
+public:
+    static const int SUB_BITS = 5;
+    static const int SUB_COUNT = 1 << SUB_BITS;
+    static const int BUCKETS = (64 - SUB_BITS + 1) * SUB_COUNT;
+
+    LatencyHistogram() { reset(); }
+
+    LatencyHistogram(const LatencyHistogram& other)
+    {
+        reset();
+        merge(other);
+    }
+
+    LatencyHistogram& operator=(const LatencyHistogram& other)
+    {
+        if(this != &other)
+        {
+            reset();
+            merge(other);
+        }
+        return *this;
+    }
+
+    void reset()
+    {
+        for(int i = 0; i < BUCKETS; ++i)
+        {
+            counts_[i].store(0, std::memory_order_relaxed);
+        }
+        total_.store(0, std::memory_order_relaxed);
+        sum_.store(0, std::memory_order_relaxed);
+        min_.store(UINT64_MAX, std::memory_order_relaxed);
+        max_.store(0, std::memory_order_relaxed);
+    }
+
+    void record(uint64_t ns)
+    {
+        add(counts_[bucketOf(ns)], 1);
+        add(total_, 1);
+        add(sum_, ns);
+        if(ns < min_.load(std::memory_order_relaxed))
+        {
+            min_.store(ns, std::memory_order_relaxed);
+        }
+        if(ns > max_.load(std::memory_order_relaxed))
+        {
+            max_.store(ns, std::memory_order_relaxed);
+        }
+    }
+
+    void merge(const LatencyHistogram& other)
+    {
+        for(int i = 0; i < BUCKETS; ++i)
+        {
+            add(counts_[i], other.counts_[i].load(std::memory_order_relaxed));
+        }
+        add(total_, other.total_.load(std::memory_order_relaxed));
+        add(sum_, other.sum_.load(std::memory_order_relaxed));
+        uint64_t otherMin = other.min_.load(std::memory_order_relaxed);
+        uint64_t otherMax = other.max_.load(std::memory_order_relaxed);
+        if(otherMin < min_.load(std::memory_order_relaxed))
+        {
+            min_.store(otherMin, std::memory_order_relaxed);
+        }
+        if(otherMax > max_.load(std::memory_order_relaxed))
+        {
+            max_.store(otherMax, std::memory_order_relaxed);
+        }
+    }
+
+    uint64_t count() const { return total_.load(std::memory_order_relaxed); }
+    uint64_t min() const { return count() == 0 ? 0 : min_.load(std::memory_order_relaxed); }
+    uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+    double mean() const { return count() == 0 ? 0.0 : (double)sum_.load(std::memory_order_relaxed) / count(); }
+
+    /**
+     * Returns the smallest recorded value v such that `percentile`
+     * percent of all samples are <= v (to bucket precision).
+     */
+    uint64_t valueAtPercentile(double percentile) const
+    {
+        uint64_t total = count();
+        if(total == 0)
+        {
+            return 0;
+        }
+        uint64_t target = (uint64_t)(percentile / 100.0 * total + 0.5);
+        if(target == 0)
+        {
+            target = 1;
+        }
+        uint64_t seen = 0;
+        for(int i = 0; i < BUCKETS; ++i)
+        {
+            seen += counts_[i].load(std::memory_order_relaxed);
+            if(seen >= target)
+            {
+                uint64_t high = highestInBucket(i);
+                return high < max() ? high : max();
+            }
+        }
+        return max();
+    }
+
+    void print(std::ostream& out, const char* name) const
+    {
+        out << name << ": count " << count() << " mean " << (uint64_t)mean() << "ns"
+            << " p50 " << valueAtPercentile(50.0) << "ns"
+            << " p99 " << valueAtPercentile(99.0) << "ns"
+            << " p99.9 " << valueAtPercentile(99.9) << "ns"
+            << " max " << max() << "ns" << std::endl;
+    }
+
+private:
+    // Single-writer increment: no read-modify-write instruction needed
+    static void add(std::atomic<uint64_t>& field, uint64_t n)
+    {
+        field.store(field.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    static int bucketOf(uint64_t v)
+    {
+        if(v < (uint64_t)SUB_COUNT)
+        {
+            return (int)v;
+        }
+        int msb = 63 - __builtin_clzll(v);
+        int shift = msb - SUB_BITS;
+        return (shift + 1) * SUB_COUNT + (int)((v >> shift) - SUB_COUNT);
+    }
+
+    static uint64_t highestInBucket(int index)
+    {
+        if(index < SUB_COUNT)
+        {
+            return (uint64_t)index;
+        }
+        int shift = index / SUB_COUNT - 1;
+        uint64_t sub = (uint64_t)(index % SUB_COUNT + SUB_COUNT);
+        return ((sub + 1) << shift) - 1;
+    }
+
+    std::atomic<uint64_t> counts_[BUCKETS];
+    std::atomic<uint64_t> total_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> min_;
+    std::atomic<uint64_t> max_;
+};
+
+/**
+ * The per-tree set of histograms, one per instrumented operation.
+ */
+struct TreeLatency {
+    LatencyHistogram insert;
+    LatencyHistogram remove;
+    LatencyHistogram find;
+    LatencyHistogram advance;
+
+    void merge(const TreeLatency& other)
+    {
+        insert.merge(other.insert);
+        remove.merge(other.remove);
+        find.merge(other.find);
+        advance.merge(other.advance);
+    }
+
+    void print(std::ostream& out) const
+    {
+        insert.print(out, "insert ");
+        remove.print(out, "remove ");
+        find.print(out, "find   ");
+        advance.print(out, "advance");
+    }
+};
+
+/**
+ * A tree's histograms, kept per thread so that threads running const
+ * lookups on the same tree never write to shared counters. Each thread
+ * records into its own TreeLatency, created on its first operation and
+ * owned here; merged() adds them up. A thread finds its shard through a
+ * short thread_local list of recently used recorders, falling back to
+ * a search under the mutex.
+ */
+class TreeLatencyRecorder
+{
+public:
+    TreeLatencyRecorder() : id_(nextId()) {}
+
+    ~TreeLatencyRecorder()
+    {
+        for(size_t i = 0; i < shards_.size(); ++i)
+        {
+            delete shards_[i].second;
+        }
+    }
+
+    /**
+     * The calling thread's histograms.
+     */
+    TreeLatency& local()
+    {
+        std::vector<std::pair<uint64_t, TreeLatency*> >& recent = recentShards();
+        for(size_t i = 0; i < recent.size(); ++i)
+        {
+            if(recent[i].first == id_)
+            {
+                return *recent[i].second;
+            }
+        }
+
+        TreeLatency* shard = NULL;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::thread::id self = std::this_thread::get_id();
+            for(size_t i = 0; i < shards_.size() && shard == NULL; ++i)
+            {
+                if(shards_[i].first == self)
+                {
+                    shard = shards_[i].second;
+                }
+            }
+            if(shard == NULL)
+            {
+                shard = new TreeLatency();
+                shards_.push_back(std::make_pair(self, shard));
+            }
+        }
+        // Recorders are never reused, so entries of destroyed ones just
+        // age out of the list
+        if(recent.size() == RECENT_SHARDS)
+        {
+            recent.erase(recent.begin());
+        }
+        recent.push_back(std::make_pair(id_, shard));
+        return *shard;
+    }
+
+    /**
+     * All threads' histograms added together.
+     */
+    TreeLatency merged() const
+    {
+        TreeLatency total;
+        std::lock_guard<std::mutex> lock(mutex_);
+        for(size_t i = 0; i < shards_.size(); ++i)
+        {
+            total.merge(*shards_[i].second);
+        }
+        return total;
+    }
+
+private:
+    static const size_t RECENT_SHARDS = 8;
+
+    TreeLatencyRecorder(const TreeLatencyRecorder&);
+    TreeLatencyRecorder& operator=(const TreeLatencyRecorder&);
+
+    static uint64_t nextId()
+    {
+        static std::atomic<uint64_t> next(1);
+        return next.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static std::vector<std::pair<uint64_t, TreeLatency*> >& recentShards()
+    {
+        static thread_local std::vector<std::pair<uint64_t, TreeLatency*> > recent;
+        return recent;
+    }
+
+    uint64_t id_;
+    mutable std::mutex mutex_;
+    std::vector<std::pair<std::thread::id, TreeLatency*> > shards_;
+};
+
+/**
+ * Records the lifetime of the scope into a histogram. A NULL histogram
+ * (tracking disabled) skips the clock reads entirely. steady_clock is
+ * served from the vDSO on Linux, so a sample costs a few tens of ns.
+ */
+class LatencyTimer
+{
+public:
+    explicit LatencyTimer(LatencyHistogram* histogram) : histogram_(histogram)
+    {
+        if(histogram_ != NULL)
+        {
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~LatencyTimer()
+    {
+        if(histogram_ != NULL)
+        {
+            std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start_;
+            histogram_->record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        }
+    }
+
+private:
+    LatencyHistogram* histogram_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+#endif
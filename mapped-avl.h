@@ -0,0 +1,245 @@
+#ifndef MAPPED_AVL_H
+#define MAPPED_AVL_H
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "compact-avl.h"
+
+/**
+ * First bytes of a tree file. The sizes guard against reopening a file
+ * with a different Key or Value type; the tree header follows so
+ * that the file alone carries the whole tree.
+ */
+struct MappedFileHeader {
+    char magic[8];        // "BSTAVL1"
+    uint32_t nodeSize;    // sizeof the node type the file was created with
+    uint32_t keySize;     // and of its key and value
+    uint32_t valueSize;
+    uint32_t dataOffset;  // byte offset of slot 0
+    CompactTreeHeader tree;
+};
+
+/**
+ * Storage policy for CompactAVLTree that keeps the header and the node
+ * array in a memory-mapped file. Links are slot indices, so they mean
+ * the same in every mapping: the file can be remapped at another address
+ * after growing or reopened by a later process, with no load step and no
+ * pointer fixups, and the OS pages cold parts of the tree in and out.
+ *
+ * Growing extends the file (doubling) and maps it again. sync() is the
+ * checkpoint: once it returns, the tree as of that moment is on disk.
+ * The OS writes pages back in no particular order between checkpoints,
+ * so a crash after further updates can leave a torn tree; copy the file
+ * at a checkpoint when that matters.
+ */
+template<typename NodeType>
+class MappedNodeStorage
+{
+public:
+    static const size_t DATA_OFFSET = 64;
+
+    MappedNodeStorage() : fd_(-1), base_(NULL), bytes_(0) {}
+    ~MappedNodeStorage() { close(); }
+
+    void open(const std::string& path, size_t initialSlots);
+    void close();
+    void sync(bool wait = true);
+    bool isOpen() const { return base_ != NULL; }
+    size_t fileBytes() const { return bytes_; }
+
+    NodeType* nodes() { return reinterpret_cast<NodeType*>(base_ + DATA_OFFSET); }
+    const NodeType* nodes() const { return reinterpret_cast<const NodeType*>(base_ + DATA_OFFSET); }
+    size_t capacity() const { return base_ != NULL ? (bytes_ - DATA_OFFSET) / sizeof(NodeType) : 0; }
+    CompactTreeHeader& header() { return fileHeader()->tree; }
+    const CompactTreeHeader& header() const { return fileHeader()->tree; }
+
+    void grow(size_t minSlots);
+    void reset();
+
+private:
+    MappedNodeStorage(const MappedNodeStorage&);
+    MappedNodeStorage& operator=(const MappedNodeStorage&);
+
+    MappedFileHeader* fileHeader() { return reinterpret_cast<MappedFileHeader*>(base_); }
+    const MappedFileHeader* fileHeader() const { return reinterpret_cast<const MappedFileHeader*>(base_); }
+    void map(size_t bytes);
+    static uint32_t keySize() { return (uint32_t)sizeof(std::declval<NodeType>().item.first); }
+    static uint32_t valueSize() { return (uint32_t)sizeof(std::declval<NodeType>().item.second); }
+
+    int fd_;
+    char* base_;
+    size_t bytes_;
+};
+
+/**
+ * Opens the tree file at path, creating it with room for initialSlots
+ * nodes if it is missing or empty.
+ */
+template<typename NodeType>
+void MappedNodeStorage<NodeType>::open(const std::string& path, size_t initialSlots)
+{
+    close();
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if(fd_ < 0)
+    {
+        throw std::system_error(errno, std::generic_category(), "open " + path);
+    }
+    struct stat st;
+    if(fstat(fd_, &st) != 0)
+    {
+        int err = errno;
+        close();
+        throw std::system_error(err, std::generic_category(), "stat " + path);
+    }
+
+    if(st.st_size == 0)
+    {
+        // New file: size it, then write a fresh header
+        size_t bytes = DATA_OFFSET + std::max<size_t>(initialSlots, 2) * sizeof(NodeType);
+        if(ftruncate(fd_, (off_t)bytes) != 0)
+        {
+            int err = errno;
+            close();
+            throw std::system_error(err, std::generic_category(), "resize " + path);
+        }
+        map(bytes);
+        MappedFileHeader* h = fileHeader();
+        std::memcpy(h->magic, "BSTAVL1", 8);
+        h->nodeSize = (uint32_t)sizeof(NodeType);
+        h->keySize = keySize();
+        h->valueSize = valueSize();
+        h->dataOffset = (uint32_t)DATA_OFFSET;
+        h->tree = CompactTreeHeader();
+        return;
+    }
+
+    if((size_t)st.st_size < DATA_OFFSET + sizeof(NodeType))
+    {
+        close();
+        throw std::runtime_error(path + " is not a tree file");
+    }
+    map((size_t)st.st_size);
+    const MappedFileHeader* h = fileHeader();
+    if(std::memcmp(h->magic, "BSTAVL1", 8) != 0 || h->dataOffset != DATA_OFFSET)
+    {
+        close();
+        throw std::runtime_error(path + " is not a tree file");
+    }
+    if(h->nodeSize != sizeof(NodeType) || h->keySize != keySize() || h->valueSize != valueSize())
+    {
+        close();
+        throw std::runtime_error(path + " was written with a different key or value type");
+    }
+}
+
+/**
+ * Checkpoints and unmaps the file. Safe to call when not open.
+ */
+template<typename NodeType>
+void MappedNodeStorage<NodeType>::close()
+{
+    if(base_ != NULL)
+    {
+        msync(base_, bytes_, MS_SYNC);
+        munmap(base_, bytes_);
+        base_ = NULL;
+        bytes_ = 0;
+    }
+    if(fd_ >= 0)
+    {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+/**
+ * Flushes the mapping to the file. With wait the call returns once the
+ * data is on disk; without, it only schedules the writes.
+ */
+template<typename NodeType>
+void MappedNodeStorage<NodeType>::sync(bool wait)
+{
+    if(base_ != NULL && msync(base_, bytes_, wait ? MS_SYNC : MS_ASYNC) != 0)
+    {
+        throw std::system_error(errno, std::generic_category(), "msync");
+    }
+}
+
+/**
+ * Extends the file to at least minSlots nodes (at least doubling it) and
+ * maps it again, possibly at another address.
+ */
+template<typename NodeType>
+void MappedNodeStorage<NodeType>::grow(size_t minSlots)
+{
+    size_t slots = std::max(minSlots, capacity() * 2);
+    size_t bytes = DATA_OFFSET + slots * sizeof(NodeType);
+    if(ftruncate(fd_, (off_t)bytes) != 0)
+    {
+        throw std::system_error(errno, std::generic_category(), "resize tree file");
+    }
+    munmap(base_, bytes_);
+    base_ = NULL;
+    map(bytes);
+}
+
+/**
+ * Empties the tree. The file keeps its size; the slots are reused.
+ */
+template<typename NodeType>
+void MappedNodeStorage<NodeType>::reset()
+{
+    header() = CompactTreeHeader();
+}
+
+template<typename NodeType>
+void MappedNodeStorage<NodeType>::map(size_t bytes)
+{
+    void* base = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if(base == MAP_FAILED)
+    {
+        int err = errno;
+        close();
+        throw std::system_error(err, std::generic_category(), "mmap tree file");
+    }
+    base_ = static_cast<char*>(base);
+    bytes_ = bytes;
+}
+
+/**
+ * A CompactAVLTree that lives in a file: opening the file is all it
+ * takes to use a tree written by an earlier run, and indexes larger than
+ * RAM are paged by the OS. Keys and values are stored as raw bytes, so
+ * they must be trivially copyable and hold no pointers. Up to 2^31 - 1
+ * nodes per file.
+ *
+ * checkpoint() makes everything so far durable; the destructor does a
+ * final one.
+ */
+template<typename Key, typename Value>
+class MappedAVLTree : public CompactAVLTree<Key, Value, MappedNodeStorage<CompactNode<Key, Value> > >
+{
+public:
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+                  "MappedAVLTree stores keys and values as raw bytes");
+
+    explicit MappedAVLTree(const std::string& path, size_t initialNodes = 1024)
+    {
+        this->storage_.open(path, initialNodes + 1);
+    }
+
+    void checkpoint(bool wait = true) { this->storage_.sync(wait); }
+    size_t fileBytes() const { return this->storage_.fileBytes(); }
+};
+
+#endif
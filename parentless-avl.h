@@ -0,0 +1,535 @@
+#ifndef PARENTLESS_AVL_H
+#define PARENTLESS_AVL_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "tree-memory.h"
+#include "tree-stats.h"
+#include "shape-report.h"
+#include "key-search.h"
+
+/**
+ * A node of a ParentlessAVLTree: the item and two child links, nothing
+ * else. The balance lives in the low bit of each link (set on the left
+ * link when the left subtree is taller, on the right link when the right
+ * one is), so with int keys and values a node is 24 bytes, no vtable.
+ *
+ * Links are indexed by direction: 0 is left, 1 is right.
+ */
+template<typename Key, typename Value>
+struct ParentlessNode {
+    ParentlessNode(const Key& key, const Value& value) : item(key, value)
+    {
+        links[0] = 0;
+        links[1] = 0;
+    }
+
+    ParentlessNode* child(int dir) const
+    {
+        return reinterpret_cast<ParentlessNode*>(links[dir] & ~(uintptr_t)1);
+    }
+
+    void setChild(int dir, ParentlessNode* node)
+    {
+        links[dir] = reinterpret_cast<uintptr_t>(node) | (links[dir] & 1);
+    }
+
+    // -1 when the left subtree is taller, 1 when the right one is, else 0
+    int balance() const
+    {
+        return (int)(links[1] & 1) - (int)(links[0] & 1);
+    }
+
+    void setBalance(int balance)
+    {
+        links[0] = (links[0] & ~(uintptr_t)1) | (balance < 0);
+        links[1] = (links[1] & ~(uintptr_t)1) | (balance > 0);
+    }
+
+    std::pair<const Key, Value> item;
+    uintptr_t links[2];
+};
+
+/**
+ * Child accessor for the generic shape analysis (shape-report.h).
+ */
+template<typename Key, typename Value>
+struct ParentlessNodeChildren {
+    void operator()(ParentlessNode<Key, Value>* node, ParentlessNode<Key, Value>*& left,
+                    ParentlessNode<Key, Value>*& right) const
+    {
+        left = node->child(0);
+        right = node->child(1);
+    }
+};
+
+/**
+ * An AVL tree whose nodes have no parent pointers. insert() and remove()
+ * record the search path on a fixed-size stack and rebalance from it on
+ * the way back, and iterators carry their own stack of the ancestors
+ * still to be visited. That saves a pointer per node (32 vs 48 bytes
+ * allocated per int/int node next to AVLTree) and the parent stores in
+ * every rotation and splice.
+ *
+ * Any insert or remove invalidates iterators, since a rotation can leave
+ * an iterator's saved ancestors stale.
+ */
+template<typename Key, typename Value>
+class ParentlessAVLTree
+{
+public:
+    typedef ParentlessNode<Key, Value> NodeType;
+
+    // An AVL tree of height h has at least Fib(h + 2) - 1 nodes, so 96
+    // levels cover any tree that fits in a 64-bit address space.
+    static const int MAX_HEIGHT = 96;
+
+    class iterator
+    {
+    public:
+        iterator() : depth_(0) {}
+
+        std::pair<const Key, Value>& operator*() const { return path_[depth_ - 1]->item; }
+        std::pair<const Key, Value>* operator->() const { return &path_[depth_ - 1]->item; }
+
+        bool operator==(const iterator& rhs) const { return current() == rhs.current(); }
+        bool operator!=(const iterator& rhs) const { return current() != rhs.current(); }
+
+        iterator& operator++()
+        {
+            NodeType* n = path_[--depth_];
+            for(n = n->child(1); n != NULL; n = n->child(0))
+            {
+                path_[depth_++] = n;
+            }
+            return *this;
+        }
+
+    private:
+        friend class ParentlessAVLTree<Key, Value>;
+
+        NodeType* current() const { return depth_ == 0 ? NULL : path_[depth_ - 1]; }
+
+        // The current node on top, below it the ancestors whose left
+        // subtree holds it (the ones still to be visited)
+        NodeType* path_[MAX_HEIGHT];
+        int depth_;
+    };
+
+    ParentlessAVLTree() : root_(NULL), size_(0), peakSize_(0) {}
+    ~ParentlessAVLTree() { clear(); }
+
+    void insert(const std::pair<const Key, Value>& item);
+    void remove(const Key& key);
+    iterator find(const Key& key) const;
+    iterator begin() const;
+    iterator end() const { return iterator(); }
+    Value& operator[](const Key& key);
+
+    void clear();
+    bool empty() const { return size_ == 0; }
+    size_t size() const { return size_; }
+    int height() const;
+    bool isBalanced() const;
+    ShapeReport shapeReport(unsigned threads = 1) const;
+    MemoryReport memoryReport() const;
+
+protected:
+    NodeType* rotate(NodeType* p, int dir);
+    NodeType* rebalance(NodeType* g, int s, int& heightChange);
+    void replaceAt(NodeType** path, const int* dirs, int i, NodeType* node);
+
+    NodeType* root_;
+    size_t size_;
+    size_t peakSize_;
+
+private:
+    ParentlessAVLTree(const ParentlessAVLTree&);
+    ParentlessAVLTree& operator=(const ParentlessAVLTree&);
+};
+
+/*
+ * Puts node where path[i] was: under path[i - 1], or at the root.
+ */
+template<typename Key, typename Value>
+void ParentlessAVLTree<Key, Value>::replaceAt(NodeType** path, const int* dirs, int i, NodeType* node)
+{
+    if(i == 0)
+    {
+        root_ = node;
+    }
+    else
+    {
+        path[i - 1]->setChild(dirs[i - 1], node);
+    }
+}
+
+/*
+ * Lifts p's child on side dir above p and returns it. Balances are left
+ * to the caller.
+ */
+template<typename Key, typename Value>
+ParentlessNode<Key, Value>* ParentlessAVLTree<Key, Value>::rotate(NodeType* p, int dir)
+{
+    NodeType* c = p->child(dir);
+    p->setChild(dir, c->child(1 - dir));
+    c->setChild(1 - dir, p);
+    return c;
+}
+
+/*
+ * Rotates g, whose s side (1: right, -1: left) has become two levels
+ * taller, returns the new subtree root and sets heightChange to the
+ * change in the subtree's height (0 or -1). Same relative-height
+ * bookkeeping as AVLTree::rebalance with a bound of 1.
+ */
+template<typename Key, typename Value>
+ParentlessNode<Key, Value>* ParentlessAVLTree<Key, Value>::rebalance(NodeType* g, int s, int& heightChange)
+{
+    int dir = s > 0 ? 1 : 0;
+    NodeType* c = g->child(dir);
+
+    // h(c) = 0 in a frame mirrored so that the heavy side is the right
+    int hgL = -2;
+    int b = s * c->balance();
+    int hcR = b >= 0 ? -1 : -1 + b;
+    int hcL = b >= 0 ? -1 - b : -1;
+    int newHeight;
+    NodeType* top;
+
+    if(b >= 0)
+    {
+        BST_STAT(STAT_SINGLE_ROTATIONS, 1);
+        int hg = 1 + std::max(hgL, hcL);
+        top = rotate(g, dir);
+        g->setBalance(s * (hcL - hgL));
+        c->setBalance(s * (hcR - hg));
+        newHeight = 1 + std::max(hg, hcR);
+    }
+    else
+    {
+        BST_STAT(STAT_DOUBLE_ROTATIONS, 1);
+        NodeType* d = c->child(1 - dir);
+        int e = s * d->balance();
+        int hdL = e >= 0 ? -2 - e : -2;
+        int hdR = e >= 0 ? -2 : -2 + e;
+        int hg = 1 + std::max(hgL, hdL);
+        int hc = 1 + std::max(hdR, hcR);
+        g->setChild(dir, rotate(c, 1 - dir));
+        top = rotate(g, dir);
+        g->setBalance(s * (hdL - hgL));
+        c->setBalance(s * (hcR - hdR));
+        d->setBalance(s * (hc - hg));
+        newHeight = 1 + std::max(hg, hc);
+    }
+    heightChange = newHeight - 1;
+    return top;
+}
+
+template<typename Key, typename Value>
+void ParentlessAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& item)
+{
+    BST_STAT(STAT_INSERTS, 1);
+    NodeType* path[MAX_HEIGHT];
+    int dirs[MAX_HEIGHT];
+    int depth = 0;
+
+    KeySearch<Key> compare(item.first);
+    for(NodeType* n = root_; n != NULL; ++depth)
+    {
+        BST_STAT(STAT_COMPARISONS, 1);
+        int order = compare.compare(n->item.first);
+        if(order == 0)
+        {
+            // update value if already in tree
+            n->item.second = item.second;
+            return;
+        }
+        path[depth] = n;
+        dirs[depth] = order > 0;
+        n = n->child(dirs[depth]);
+    }
+
+    NodeType* added = new NodeType(item.first, item.second);
+    if(++size_ > peakSize_)
+    {
+        peakSize_ = size_;
+    }
+    replaceAt(path, dirs, depth, added);
+
+    // Retrace: each ancestor's dirs side grew by one level
+    for(int i = depth - 1; i >= 0; --i)
+    {
+        BST_STAT(STAT_REBALANCE_STEPS, 1);
+        NodeType* p = path[i];
+        int s = dirs[i] ? 1 : -1;
+        int old = p->balance();
+        if(old == -s)
+        {
+            // The shorter side caught up, so p's height did not change
+            p->setBalance(0);
+            return;
+        }
+        if(old == 0)
+        {
+            p->setBalance(s);
+            continue;
+        }
+        // A rotation after an insert restores the old height
+        int heightChange;
+        replaceAt(path, dirs, i, rebalance(p, s, heightChange));
+        return;
+    }
+}
+
+template<typename Key, typename Value>
+void ParentlessAVLTree<Key, Value>::remove(const Key& key)
+{
+    BST_STAT(STAT_REMOVES, 1);
+    NodeType* path[MAX_HEIGHT];
+    int dirs[MAX_HEIGHT];
+    int depth = 0;
+
+    KeySearch<Key> compare(key);
+    NodeType* target = root_;
+    while(target != NULL)
+    {
+        BST_STAT(STAT_COMPARISONS, 1);
+        int order = compare.compare(target->item.first);
+        if(order == 0)
+        {
+            break;
+        }
+        path[depth] = target;
+        dirs[depth] = order > 0;
+        target = target->child(dirs[depth]);
+        ++depth;
+    }
+    if(target == NULL)
+    {
+        return;
+    }
+
+    int targetDepth = depth;
+    if(target->child(0) != NULL && target->child(1) != NULL)
+    {
+        // Continue to the predecessor, unlink it, and put it in target's place
+        path[depth] = target;
+        dirs[depth] = 0;
+        ++depth;
+        NodeType* pred = target->child(0);
+        while(pred->child(1) != NULL)
+        {
+            path[depth] = pred;
+            dirs[depth] = 1;
+            ++depth;
+            pred = pred->child(1);
+        }
+        path[depth - 1]->setChild(dirs[depth - 1], pred->child(0));
+        pred->setChild(0, target->child(0));
+        pred->setChild(1, target->child(1));
+        pred->setBalance(target->balance());
+        replaceAt(path, dirs, targetDepth, pred);
+        path[targetDepth] = pred;
+    }
+    else
+    {
+        replaceAt(path, dirs, depth, target->child(target->child(0) == NULL ? 1 : 0));
+    }
+    delete target;
+    --size_;
+
+    // Retrace: each ancestor's dirs side lost one level
+    for(int i = depth - 1; i >= 0; --i)
+    {
+        BST_STAT(STAT_REBALANCE_STEPS, 1);
+        NodeType* p = path[i];
+        int s = dirs[i] ? 1 : -1;
+        int old = p->balance();
+        if(old == s)
+        {
+            p->setBalance(0);
+            continue;
+        }
+        if(old == 0)
+        {
+            // The other side still holds the height
+            p->setBalance(-s);
+            return;
+        }
+        int heightChange;
+        replaceAt(path, dirs, i, rebalance(p, -s, heightChange));
+        if(heightChange == 0)
+        {
+            return;
+        }
+    }
+}
+
+template<typename Key, typename Value>
+typename ParentlessAVLTree<Key, Value>::iterator ParentlessAVLTree<Key, Value>::find(const Key& key) const
+{
+    BST_STAT(STAT_FINDS, 1);
+    iterator it;
+    KeySearch<Key> compare(key);
+    for(NodeType* n = root_; n != NULL;)
+    {
+        BST_STAT(STAT_COMPARISONS, 1);
+        int order = compare.compare(n->item.first);
+        if(order == 0)
+        {
+            it.path_[it.depth_++] = n;
+            return it;
+        }
+        if(order < 0)
+        {
+            // n comes after everything in its left subtree
+            it.path_[it.depth_++] = n;
+        }
+        n = n->child(order > 0);
+    }
+    return iterator();
+}
+
+template<typename Key, typename Value>
+typename ParentlessAVLTree<Key, Value>::iterator ParentlessAVLTree<Key, Value>::begin() const
+{
+    iterator it;
+    for(NodeType* n = root_; n != NULL; n = n->child(0))
+    {
+        it.path_[it.depth_++] = n;
+    }
+    return it;
+}
+
+/**
+ * @precondition The key exists in the map
+ */
+template<typename Key, typename Value>
+Value& ParentlessAVLTree<Key, Value>::operator[](const Key& key)
+{
+    KeySearch<Key> compare(key);
+    for(NodeType* n = root_; n != NULL;)
+    {
+        int order = compare.compare(n->item.first);
+        if(order == 0)
+        {
+            return n->item.second;
+        }
+        n = n->child(order > 0);
+    }
+    throw std::out_of_range("Invalid key");
+}
+
+/**
+ * Deletes every node without a stack: rotating left children up turns
+ * the tree into a right-leaning list that is freed from the top.
+ */
+template<typename Key, typename Value>
+void ParentlessAVLTree<Key, Value>::clear()
+{
+    while(root_ != NULL)
+    {
+        if(root_->child(0) != NULL)
+        {
+            root_ = rotate(root_, 0);
+        }
+        else
+        {
+            NodeType* next = root_->child(1);
+            delete root_;
+            root_ = next;
+        }
+    }
+    size_ = 0;
+}
+
+/**
+ * Height of the tree, following the taller child down: O(log n).
+ */
+template<typename Key, typename Value>
+int ParentlessAVLTree<Key, Value>::height() const
+{
+    int h = 0;
+    for(NodeType* n = root_; n != NULL; n = n->child(n->balance() < 0 ? 0 : 1))
+    {
+        ++h;
+    }
+    return h;
+}
+
+/**
+ * Checks every stored balance against the real subtree heights and the
+ * AVL bound in one iterative post-order pass.
+ */
+template<typename Key, typename Value>
+bool ParentlessAVLTree<Key, Value>::isBalanced() const
+{
+    std::vector<std::pair<NodeType*, bool> > stack;
+    std::vector<int> heights;
+    if(root_ != NULL)
+    {
+        stack.push_back(std::make_pair(root_, false));
+    }
+    while(!stack.empty())
+    {
+        NodeType* n = stack.back().first;
+        bool childrenDone = stack.back().second;
+        stack.pop_back();
+        if(!childrenDone)
+        {
+            stack.push_back(std::make_pair(n, true));
+            if(n->child(1) != NULL)
+            {
+                stack.push_back(std::make_pair(n->child(1), false));
+            }
+            if(n->child(0) != NULL)
+            {
+                stack.push_back(std::make_pair(n->child(0), false));
+            }
+            continue;
+        }
+        int rightH = 0;
+        int leftH = 0;
+        if(n->child(1) != NULL)
+        {
+            rightH = heights.back();
+            heights.pop_back();
+        }
+        if(n->child(0) != NULL)
+        {
+            leftH = heights.back();
+            heights.pop_back();
+        }
+        if(n->balance() != rightH - leftH || std::abs(rightH - leftH) > 1)
+        {
+            return false;
+        }
+        heights.push_back(1 + std::max(leftH, rightH));
+    }
+    return true;
+}
+
+template<typename Key, typename Value>
+ShapeReport ParentlessAVLTree<Key, Value>::shapeReport(unsigned threads) const
+{
+    return analyzeShape(root_, ParentlessNodeChildren<Key, Value>(), threads);
+}
+
+template<typename Key, typename Value>
+MemoryReport ParentlessAVLTree<Key, Value>::memoryReport() const
+{
+    MemoryReport report;
+    // The balance lives in the link tag bits
+    report.node = describeNode<NodeType, Key, Value>(2, 0);
+    report.liveNodes = size_;
+    report.peakNodes = peakSize_;
+    return report;
+}
+
+#endif
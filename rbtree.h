@@ -0,0 +1,484 @@
+#ifndef RBTREE_H
+#define RBTREE_H
+
+#include "bst.h"
+#include <cstdlib>
+#include <iostream>
+
+enum RBColor { RB_RED = 0, RB_BLACK = 1 };
+
+/**
+ * A node for a red-black tree: the plain Node with its color kept in a
+ * tag bit of the links (see Node), so it is no larger than a plain Node.
+ */
+template<typename Key, typename Value>
+class RBNode : public Node<Key, Value> {
+public:
+    // Constructor/destructor.
+    RBNode(const Key& key, const Value& value, RBNode<Key, Value>* parent);
+    virtual ~RBNode();
+
+    // Getter/setter for the node's color.
+    RBColor getColor() const;
+    void setColor(RBColor color);
+    bool isRed() const;
+    virtual RBNode<Key, Value>* clone() const override;
+
+    // Getters for parent, left, and right, redefined to return RBNodes.
+    virtual RBNode<Key, Value>* getParent() const override;
+    virtual RBNode<Key, Value>* getLeft() const override;
+    virtual RBNode<Key, Value>* getRight() const override;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the RBNode class.
+  -------------------------------------------------
+*/
+
+/**
+ * New nodes start out red.
+ */
+template<class Key, class Value>
+RBNode<Key, Value>::RBNode(const Key& key, const Value& value, RBNode<Key, Value>* parent)
+        : Node<Key, Value>(key, value, parent) {}
+
+/**
+ * A destructor which does nothing.
+ */
+template<class Key, class Value>
+RBNode<Key, Value>::~RBNode() {}
+
+/**
+ * Copy with the same color.
+ */
+template<class Key, class Value>
+RBNode<Key, Value>* RBNode<Key, Value>::clone() const {
+    RBNode<Key, Value>* copy = new RBNode<Key, Value>(this->getKey(), this->getValue(), nullptr);
+    copy->setTag(this->getTag());
+    return copy;
+}
+
+/**
+ * A getter for the color of a RBNode.
+ */
+template<class Key, class Value>
+RBColor RBNode<Key, Value>::getColor() const {
+    return (RBColor)(this->getTag() & 1);
+}
+
+/**
+ * A setter for the color of a RBNode.
+ */
+template<class Key, class Value>
+void RBNode<Key, Value>::setColor(RBColor color) {
+    this->setTag((this->getTag() & ~1u) | (unsigned)color);
+}
+
+/**
+ * True if the node is red.
+ */
+template<class Key, class Value>
+bool RBNode<Key, Value>::isRed() const {
+    return (this->getTag() & 1) == RB_RED;
+}
+
+/**
+ * Overridden to return a RBNode, see AVLNode.
+ */
+template<class Key, class Value>
+RBNode<Key, Value>* RBNode<Key, Value>::getParent() const {
+    return static_cast<RBNode<Key, Value>*>(Node<Key, Value>::getParent());
+}
+
+/**
+ * Overridden for the same reasons as above.
+ */
+template<class Key, class Value>
+RBNode<Key, Value>* RBNode<Key, Value>::getLeft() const {
+    return static_cast<RBNode<Key, Value>*>(Node<Key, Value>::getLeft());
+}
+
+/**
+ * Overridden for the same reasons as above.
+ */
+template<class Key, class Value>
+RBNode<Key, Value>* RBNode<Key, Value>::getRight() const {
+    return static_cast<RBNode<Key, Value>*>(Node<Key, Value>::getRight());
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the RBNode class.
+  -----------------------------------------------
+*/
+
+/**
+ * A red-black tree. It only guarantees a height of at most 2 log2(n+1)
+ * (AVL: about 1.44 log2 n), but needs at most two rotations per insert
+ * and three per remove, which suits write-heavy workloads.
+ */
+template<class Key, class Value>
+class RedBlackTree : public BinarySearchTree<Key, Value> {
+public:
+    virtual void remove(const Key& key);
+    virtual bool isBalanced() const override;
+protected:
+    virtual Node<Key, Value>* insertAt(const NodeSearch<Key, Value>& found,
+                                       const std::pair<const Key, Value>& new_item) override;
+    virtual void nodeSwap(RBNode<Key, Value>* n1, RBNode<Key, Value>* n2);
+    virtual NodeLayout nodeLayout() const override;
+    virtual size_t eraseKeys(const Key* low, const Key* high) override;
+    virtual void rebuiltTree() override;
+
+    // Helper functions
+    void insert_fix(RBNode<Key, Value>* n);
+    void remove_fix(RBNode<Key, Value>* x, RBNode<Key, Value>* parent);
+    int blackHeight(RBNode<Key, Value>* n) const;
+    static bool isRed(RBNode<Key, Value>* n);
+};
+
+/*
+ * If key is already in the tree, overwrite the current value.
+ */
+template<class Key, class Value>
+Node<Key, Value>* RedBlackTree<Key, Value>::insertAt(const NodeSearch<Key, Value>& found,
+                                                     const std::pair<const Key, Value>& new_item) {
+    if (found.node != nullptr) {
+        // update value if already in tree
+        found.node->setValue(new_item.second);
+        return found.node;
+    }
+
+    RBNode<Key, Value>* node = static_cast<RBNode<Key, Value>*>(found.parent);
+    RBNode<Key, Value>* newNode = new RBNode<Key, Value>(new_item.first, new_item.second, node);
+    this->noteNodeAdded(newNode);
+    if (node == nullptr) {
+        this->root_ = newNode;
+    } else if (found.left) {
+        node->setLeft(newNode);
+    } else {
+        node->setRight(newNode);
+    }
+    insert_fix(newNode);
+    return newNode;
+}
+
+/*
+ * Restores the red-black properties after inserting the red node n:
+ * recolor while the uncle is red, otherwise rotate once or twice.
+ */
+template<class Key, class Value>
+void RedBlackTree<Key, Value>::insert_fix(RBNode<Key, Value>* n) {
+    RBNode<Key, Value>* p = n->getParent();
+    while (isRed(p)) {
+        BST_STAT(STAT_REBALANCE_STEPS, 1);
+
+        // A red parent is never the root, so the grandparent exists
+        RBNode<Key, Value>* g = p->getParent();
+        if (p == g->getLeft()) {
+            RBNode<Key, Value>* u = g->getRight();
+
+            // Red uncle: push the blackness down from g and continue at g
+            if (isRed(u)) {
+                p->setColor(RB_BLACK);
+                u->setColor(RB_BLACK);
+                g->setColor(RB_RED);
+                n = g;
+                p = n->getParent();
+                continue;
+            }
+
+            // zig zag: turn it into zig zig first
+            if (n == p->getRight()) {
+                BST_STAT(STAT_DOUBLE_ROTATIONS, 1);
+                this->rotateLeft(p);
+                n = p;
+                p = n->getParent();
+            } else {
+                BST_STAT(STAT_SINGLE_ROTATIONS, 1);
+            }
+
+            // zig zig
+            p->setColor(RB_BLACK);
+            g->setColor(RB_RED);
+            this->rotateRight(g);
+        } else {
+            RBNode<Key, Value>* u = g->getLeft();
+
+            // Red uncle: push the blackness down from g and continue at g
+            if (isRed(u)) {
+                p->setColor(RB_BLACK);
+                u->setColor(RB_BLACK);
+                g->setColor(RB_RED);
+                n = g;
+                p = n->getParent();
+                continue;
+            }
+
+            // zig zag: turn it into zig zig first
+            if (n == p->getLeft()) {
+                BST_STAT(STAT_DOUBLE_ROTATIONS, 1);
+                this->rotateRight(p);
+                n = p;
+                p = n->getParent();
+            } else {
+                BST_STAT(STAT_SINGLE_ROTATIONS, 1);
+            }
+
+            // zig zig
+            p->setColor(RB_BLACK);
+            g->setColor(RB_RED);
+            this->rotateLeft(g);
+        }
+        break;
+    }
+    static_cast<RBNode<Key, Value>*>(this->root_)->setColor(RB_BLACK);
+}
+
+/*
+ * Range erase one key at a time, O(k log n): red-black joins would need
+ * black heights along every split path, and at most three rotations per
+ * remove already keep the per-key cost low.
+ */
+template<class Key, class Value>
+size_t RedBlackTree<Key, Value>::eraseKeys(const Key* low, const Key* high) {
+    std::vector<Key> keys;
+    Node<Key, Value>* n = low != nullptr ? this->lowerBound(*low) : this->getSmallestNode();
+    for (; n != nullptr && (high == nullptr || n->getKey() < *high); n = this->successor(n)) {
+        keys.push_back(n->getKey());
+    }
+    for (size_t i = 0; i < keys.size(); ++i) {
+        remove(keys[i]);
+    }
+    return keys.size();
+}
+
+/*
+ * Colors a tree relinked by linkBalanced(), whose missing children are
+ * all on the last two levels: every node black except a partial last
+ * level, which is red so that all paths keep the same black count.
+ */
+template<class Key, class Value>
+void RedBlackTree<Key, Value>::rebuiltTree() {
+    std::vector<RBNode<Key, Value>*> level;
+    if (this->root_ != nullptr) {
+        level.push_back(static_cast<RBNode<Key, Value>*>(this->root_));
+    }
+    size_t full = 1;
+    while (!level.empty()) {
+        std::vector<RBNode<Key, Value>*> next;
+        for (size_t i = 0; i < level.size(); ++i) {
+            RBNode<Key, Value>* n = level[i];
+            n->setColor(RB_BLACK);
+            if (n->getLeft() != nullptr) {
+                next.push_back(n->getLeft());
+            }
+            if (n->getRight() != nullptr) {
+                next.push_back(n->getRight());
+            }
+        }
+        if (next.empty() && level.size() < full) {
+            for (size_t i = 0; i < level.size(); ++i) {
+                level[i]->setColor(RB_RED);
+            }
+        }
+        level.swap(next);
+        full *= 2;
+    }
+}
+
+/*
+ * As in the other trees, a node with two children is swapped with its
+ * predecessor first so that the node actually unlinked has at most one
+ * child.
+ */
+template<class Key, class Value>
+void RedBlackTree<Key, Value>::remove(const Key& key) {
+    BST_STAT(STAT_REMOVES, 1);
+    LatencyTimer timer(this->latency_ ? &this->latency_->local().remove : NULL);
+
+    Node<Key, Value>* found = this->internalFind(key);
+    if (found == nullptr) {
+        return;
+    }
+    RBNode<Key, Value>* current = static_cast<RBNode<Key, Value>*>(found);
+
+    if (current->getLeft() != nullptr && current->getRight() != nullptr) {
+        Node<Key, Value>* pred = BinarySearchTree<Key, Value>::predecessor(current);
+        nodeSwap(current, static_cast<RBNode<Key, Value>*>(pred));
+    }
+
+    // The child that takes the node's place, and where it hangs
+    RBNode<Key, Value>* child = current->getLeft() != nullptr ? current->getLeft() : current->getRight();
+    RBNode<Key, Value>* parent = current->getParent();
+    bool removedBlack = !current->isRed();
+
+    this->spliceOut(current);
+    this->noteNodeRemoved(current);
+    delete current;
+
+    // Removing a black node shortens one path; a red child can absorb
+    // that by turning black, otherwise fix up from its position
+    if (removedBlack) {
+        if (isRed(child)) {
+            child->setColor(RB_BLACK);
+        } else {
+            remove_fix(child, parent);
+        }
+    }
+}
+
+/*
+ * x (possibly NULL) sits at a position that is one black node short.
+ * Standard CLRS fixup, using parent because x may be NULL.
+ */
+template<class Key, class Value>
+void RedBlackTree<Key, Value>::remove_fix(RBNode<Key, Value>* x, RBNode<Key, Value>* parent) {
+    while (x != this->root_ && !isRed(x)) {
+        BST_STAT(STAT_REBALANCE_STEPS, 1);
+        if (x == parent->getLeft()) {
+            RBNode<Key, Value>* w = parent->getRight();
+
+            // Red sibling: rotate so the sibling is black
+            if (isRed(w)) {
+                BST_STAT(STAT_SINGLE_ROTATIONS, 1);
+                w->setColor(RB_BLACK);
+                parent->setColor(RB_RED);
+                this->rotateLeft(parent);
+                w = parent->getRight();
+            }
+
+            // Both nephews black: recolor and move the problem up
+            if (!isRed(w->getLeft()) && !isRed(w->getRight())) {
+                w->setColor(RB_RED);
+                x = parent;
+                parent = x->getParent();
+                continue;
+            }
+
+            // Far nephew black: rotate the near one into its place
+            if (!isRed(w->getRight())) {
+                BST_STAT(STAT_DOUBLE_ROTATIONS, 1);
+                w->getLeft()->setColor(RB_BLACK);
+                w->setColor(RB_RED);
+                this->rotateRight(w);
+                w = parent->getRight();
+            } else {
+                BST_STAT(STAT_SINGLE_ROTATIONS, 1);
+            }
+
+            // Far nephew red: one rotation finishes
+            w->setColor(parent->getColor());
+            parent->setColor(RB_BLACK);
+            w->getRight()->setColor(RB_BLACK);
+            this->rotateLeft(parent);
+        } else {
+            RBNode<Key, Value>* w = parent->getLeft();
+
+            // Red sibling: rotate so the sibling is black
+            if (isRed(w)) {
+                BST_STAT(STAT_SINGLE_ROTATIONS, 1);
+                w->setColor(RB_BLACK);
+                parent->setColor(RB_RED);
+                this->rotateRight(parent);
+                w = parent->getLeft();
+            }
+
+            // Both nephews black: recolor and move the problem up
+            if (!isRed(w->getLeft()) && !isRed(w->getRight())) {
+                w->setColor(RB_RED);
+                x = parent;
+                parent = x->getParent();
+                continue;
+            }
+
+            // Far nephew black: rotate the near one into its place
+            if (!isRed(w->getLeft())) {
+                BST_STAT(STAT_DOUBLE_ROTATIONS, 1);
+                w->getRight()->setColor(RB_BLACK);
+                w->setColor(RB_RED);
+                this->rotateLeft(w);
+                w = parent->getLeft();
+            } else {
+                BST_STAT(STAT_SINGLE_ROTATIONS, 1);
+            }
+
+            // Far nephew red: one rotation finishes
+            w->setColor(parent->getColor());
+            parent->setColor(RB_BLACK);
+            w->getLeft()->setColor(RB_BLACK);
+            this->rotateRight(parent);
+        }
+        x = static_cast<RBNode<Key, Value>*>(this->root_);
+        break;
+    }
+    if (x != nullptr) {
+        x->setColor(RB_BLACK);
+    }
+}
+
+/**
+ * Null children count as black.
+ */
+template<class Key, class Value>
+bool RedBlackTree<Key, Value>::isRed(RBNode<Key, Value>* n) {
+    return n != nullptr && n->isRed();
+}
+
+/**
+ * Checks the red-black invariants: black root, no red node with a red
+ * child and the same number of black nodes on every path.
+ */
+template<class Key, class Value>
+bool RedBlackTree<Key, Value>::isBalanced() const {
+    RBNode<Key, Value>* root = static_cast<RBNode<Key, Value>*>(this->root_);
+    if (isRed(root)) {
+        return false;
+    }
+    return blackHeight(root) >= 0;
+}
+
+/**
+ * Black height of the subtree at n, or -1 if it breaks an invariant.
+ * Recursion depth is bounded by the tree height, at most 2 log2(n+1).
+ */
+template<class Key, class Value>
+int RedBlackTree<Key, Value>::blackHeight(RBNode<Key, Value>* n) const {
+    if (n == nullptr) {
+        return 0;
+    }
+    if (isRed(n) && (isRed(n->getLeft()) || isRed(n->getRight()))) {
+        return -1;
+    }
+    int leftB = blackHeight(n->getLeft());
+    int rightB = blackHeight(n->getRight());
+    if (leftB < 0 || leftB != rightB) {
+        return -1;
+    }
+    return leftB + (isRed(n) ? 0 : 1);
+}
+
+/**
+ * Colors belong to positions in the tree, so they are swapped along
+ * with the nodes.
+ */
+template<class Key, class Value>
+void RedBlackTree<Key, Value>::nodeSwap(RBNode<Key, Value>* n1, RBNode<Key, Value>* n2) {
+    BinarySearchTree<Key, Value>::nodeSwap(n1, n2);
+    RBColor tempC = n1->getColor();
+    n1->setColor(n2->getColor());
+    n2->setColor(tempC);
+}
+
+/**
+ * RB nodes are the size of a plain Node: the color sits in a tag bit of
+ * the links.
+ */
+template<class Key, class Value>
+NodeLayout RedBlackTree<Key, Value>::nodeLayout() const {
+    // The color lives in a link tag bit
+    return describeNode<RBNode<Key, Value>, Key, Value>(3, 0);
+}
+
+#endif
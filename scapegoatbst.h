@@ -0,0 +1,206 @@
+#ifndef SCAPEGOATBST_H
+#define SCAPEGOATBST_H
+
+#include "bst.h"
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+/**
+ * A scapegoat tree: a balanced BinarySearchTree whose nodes are plain
+ * Nodes with no per-node balance data. The only extra state is the
+ * tree-wide maxSize_.
+ *
+ * With balance factor alpha (0.5 < alpha < 1), an insert that lands
+ * deeper than log_{1/alpha}(n) walks back up to the first ancestor whose
+ * child holds more than alpha of its subtree (the scapegoat) and rebuilds
+ * that subtree perfectly balanced in linear time. A remove that leaves
+ * fewer than alpha * maxSize_ nodes rebuilds the whole tree. Height stays
+ * O(log n) and updates cost O(log n) amortized.
+ */
+template<class Key, class Value>
+class ScapegoatTree : public BinarySearchTree<Key, Value> {
+public:
+    explicit ScapegoatTree(double alpha = 0.7);
+    virtual void remove(const Key& key);
+    size_t rebuilds() const;
+protected:
+    virtual Node<Key, Value>* insertAt(const NodeSearch<Key, Value>& found,
+                                       const std::pair<const Key, Value>& new_item) override;
+    virtual size_t eraseKeys(const Key* low, const Key* high) override;
+    virtual void rebuiltTree() override;
+
+    // Helper functions
+    int depthBound(size_t n) const;
+    static int balancedDepth(size_t n);
+    void rebuildRoot();
+
+    double alpha_;
+    size_t maxSize_;
+    size_t rebuilds_;
+    int depthLimit_;  // no node is deeper than this
+};
+
+/**
+ * alpha near 0.5 keeps the tree close to perfectly balanced at the cost
+ * of more rebuilds; near 1 it rebuilds rarely and allows taller trees.
+ */
+template<class Key, class Value>
+ScapegoatTree<Key, Value>::ScapegoatTree(double alpha) : alpha_(alpha), maxSize_(0), rebuilds_(0), depthLimit_(0)
+{
+    if (alpha_ <= 0.5 || alpha_ >= 1.0) {
+        throw std::invalid_argument("ScapegoatTree alpha must be in (0.5, 1)");
+    }
+}
+
+/**
+ * Number of subtree rebuilds so far.
+ */
+template<class Key, class Value>
+size_t ScapegoatTree<Key, Value>::rebuilds() const
+{
+    return rebuilds_;
+}
+
+/*
+ * Deepest depth (in edges) a node may sit at in an n-node tree.
+ */
+template<class Key, class Value>
+int ScapegoatTree<Key, Value>::depthBound(size_t n) const
+{
+    return n <= 1 ? 0 : (int)std::floor(std::log((double)n) / std::log(1.0 / alpha_));
+}
+
+/*
+ * Deepest depth in a perfectly balanced n-node tree.
+ */
+template<class Key, class Value>
+int ScapegoatTree<Key, Value>::balancedDepth(size_t n)
+{
+    int depth = 0;
+    while (n > 1) {
+        n >>= 1;
+        ++depth;
+    }
+    return depth;
+}
+
+/*
+ * Rebuilds the whole tree perfectly balanced and restarts the size and
+ * depth bookkeeping from it.
+ */
+template<class Key, class Value>
+void ScapegoatTree<Key, Value>::rebuildRoot()
+{
+    this->rebuildSubtree(this->root_);
+    ++rebuilds_;
+    maxSize_ = this->nodeCount_;
+    depthLimit_ = balancedDepth(this->nodeCount_);
+}
+
+/*
+ * Inserts like a plain BST, then rebuilds at the scapegoat if the new
+ * node is too deep.
+ */
+template<class Key, class Value>
+Node<Key, Value>* ScapegoatTree<Key, Value>::insertAt(const NodeSearch<Key, Value>& found,
+                                                      const std::pair<const Key, Value>& new_item)
+{
+    if (found.node != nullptr) {
+        // update value if already in tree
+        found.node->setValue(new_item.second);
+        return found.node;
+    }
+
+    Node<Key, Value>* newNode = new Node<Key, Value>(new_item.first, new_item.second, found.parent);
+    this->noteNodeAdded(newNode);
+    if (found.parent == nullptr) {
+        this->root_ = newNode;
+    } else if (found.left) {
+        found.parent->setLeft(newNode);
+    } else {
+        found.parent->setRight(newNode);
+    }
+    if (this->nodeCount_ > maxSize_) {
+        maxSize_ = this->nodeCount_;
+    }
+
+    // Searches that started from a hint do not know the depth
+    int depth = found.depth >= 0 ? found.depth : this->nodeDepth(newNode);
+    if (depth > depthBound(this->nodeCount_) && this->rebuildScapegoat(newNode, alpha_)) {
+        // A rebuilt subtree is no taller than it was before the insert
+        ++rebuilds_;
+    } else if (depth > depthLimit_) {
+        depthLimit_ = depth;
+    }
+    return newNode;
+}
+
+/*
+ * Removes like a plain BST; rebuilds the whole tree once it has shrunk
+ * below alpha of its size at the last full rebuild.
+ */
+template<class Key, class Value>
+void ScapegoatTree<Key, Value>::remove(const Key& key)
+{
+    BST_STAT(STAT_REMOVES, 1);
+    LatencyTimer timer(this->latency_ ? &this->latency_->local().remove : NULL);
+
+    Node<Key, Value>* current = this->internalFind(key);
+    if (current == nullptr) {
+        return;
+    }
+    if (current->getLeft() != nullptr && current->getRight() != nullptr) {
+        this->nodeSwap(current, BinarySearchTree<Key, Value>::predecessor(current));
+    }
+    this->spliceOut(current);
+    this->noteNodeRemoved(current);
+    delete current;
+
+    if ((double)this->nodeCount_ < alpha_ * (double)maxSize_) {
+        rebuildRoot();
+    }
+}
+
+/**
+ * Range erase splits and joins like a plain BST. The splits never move a
+ * node down, but joining keys on both sides of the range puts every node
+ * one level deeper, so repeated erases in the middle would grow the tree
+ * without bound. Each such join raises depthLimit_, and once that passes
+ * log_{1/alpha}(n) the whole tree is rebuilt; a perfectly balanced tree
+ * leaves room for many joins, so the rebuilds are amortized over them.
+ * Also rebuilds under the same size rule as remove().
+ */
+template<class Key, class Value>
+size_t ScapegoatTree<Key, Value>::eraseKeys(const Key* low, const Key* high)
+{
+    bool joins = false;
+    if (low != nullptr && high != nullptr && this->root_ != nullptr) {
+        Node<Key, Value>* largest = this->root_;
+        while (largest->getRight() != nullptr) {
+            largest = largest->getRight();
+        }
+        joins = this->getSmallestNode()->getKey() < *low && !(largest->getKey() < *high);
+    }
+
+    size_t erased = BinarySearchTree<Key, Value>::eraseKeys(low, high);
+    if (joins) {
+        ++depthLimit_;
+    }
+    if ((double)this->nodeCount_ < alpha_ * (double)maxSize_ || depthLimit_ > depthBound(this->nodeCount_)) {
+        rebuildRoot();
+    }
+    return erased;
+}
+
+/**
+ * A merged tree is perfectly balanced, like after a full rebuild.
+ */
+template<class Key, class Value>
+void ScapegoatTree<Key, Value>::rebuiltTree()
+{
+    maxSize_ = this->nodeCount_;
+    depthLimit_ = balancedDepth(this->nodeCount_);
+}
+
+#endif
@@ -0,0 +1,209 @@
+#ifndef SHAPE_REPORT_H
+#define SHAPE_REPORT_H
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * Shape statistics of a binary tree, gathered in one traversal.
+ *
+ * Depths count edges from the root (the root is at depth 0), so the
+ * internal path length is the sum of all node depths and the average
+ * depth is the expected number of links followed by a successful search.
+ */
+struct ShapeReport {
+    size_t nodes;
+    size_t leaves;
+    size_t oneChild;                  // nodes with exactly one child
+    uint64_t internalPathLength;      // sum of the depths of all nodes
+    int maxDepth;                     // deepest node (-1 for an empty tree)
+    std::vector<size_t> leafDepths;   // leafDepths[d] = number of leaves at depth d
+
+    ShapeReport() : nodes(0), leaves(0), oneChild(0), internalPathLength(0), maxDepth(-1) {}
+
+    double averageDepth() const { return nodes == 0 ? 0.0 : (double)internalPathLength / nodes; }
+    double oneChildFraction() const { return nodes == 0 ? 0.0 : (double)oneChild / nodes; }
+
+    // True when every leaf is at the same depth (what equalPaths checks).
+    bool equalLeafDepths() const
+    {
+        int used = 0;
+        for(size_t d = 0; d < leafDepths.size(); ++d)
+        {
+            if(leafDepths[d] != 0)
+            {
+                ++used;
+            }
+        }
+        return used <= 1;
+    }
+
+    // Accounts for one node at the given depth with `children` children.
+    void add(int depth, int children)
+    {
+        ++nodes;
+        internalPathLength += (uint64_t)depth;
+        if(depth > maxDepth)
+        {
+            maxDepth = depth;
+        }
+        if(children == 0)
+        {
+            ++leaves;
+            if(leafDepths.size() <= (size_t)depth)
+            {
+                leafDepths.resize((size_t)depth + 1, 0);
+            }
+            ++leafDepths[depth];
+        }
+        else if(children == 1)
+        {
+            ++oneChild;
+        }
+    }
+
+    void merge(const ShapeReport& other)
+    {
+        nodes += other.nodes;
+        leaves += other.leaves;
+        oneChild += other.oneChild;
+        internalPathLength += other.internalPathLength;
+        if(other.maxDepth > maxDepth)
+        {
+            maxDepth = other.maxDepth;
+        }
+        if(leafDepths.size() < other.leafDepths.size())
+        {
+            leafDepths.resize(other.leafDepths.size(), 0);
+        }
+        for(size_t d = 0; d < other.leafDepths.size(); ++d)
+        {
+            leafDepths[d] += other.leafDepths[d];
+        }
+    }
+
+    void print(std::ostream& out) const
+    {
+        out << "nodes:          " << nodes << "\n"
+            << "leaves:         " << leaves << "\n"
+            << "max depth:      " << maxDepth << "\n"
+            << "average depth:  " << averageDepth() << "\n"
+            << "path length:    " << internalPathLength << "\n"
+            << "one-child frac: " << oneChildFraction() << "\n"
+            << "leaf depths:   ";
+        for(size_t d = 0; d < leafDepths.size(); ++d)
+        {
+            if(leafDepths[d] != 0)
+            {
+                out << " " << d << ":" << leafDepths[d];
+            }
+        }
+        out << std::endl;
+    }
+};
+
+/**
+ * Walks the subtree at root (which sits at `depth`) into report using
+ * an explicit stack. `children(node, left, right)` fetches the children
+ * of a node, which lets the same walk serve any node type.
+ */
+template<typename NodePtr, typename Children>
+void shapeWalk(NodePtr root, int depth, Children children, ShapeReport& report)
+{
+    std::vector<std::pair<NodePtr, int> > stack;
+    if(root != NULL)
+    {
+        stack.push_back(std::make_pair(root, depth));
+    }
+    while(!stack.empty())
+    {
+        NodePtr node = stack.back().first;
+        int d = stack.back().second;
+        stack.pop_back();
+
+        NodePtr left;
+        NodePtr right;
+        children(node, left, right);
+        report.add(d, (left != NULL) + (right != NULL));
+        if(right != NULL)
+        {
+            stack.push_back(std::make_pair(right, d + 1));
+        }
+        if(left != NULL)
+        {
+            stack.push_back(std::make_pair(left, d + 1));
+        }
+    }
+}
+
+/**
+ * Computes the ShapeReport of a tree. With threads > 1 the top levels
+ * are expanded breadth first until there are a few subtrees per thread,
+ * and the subtrees are then walked in parallel and merged.
+ */
+template<typename NodePtr, typename Children>
+ShapeReport analyzeShape(NodePtr root, Children children, unsigned threads = 1)
+{
+    ShapeReport report;
+    if(root == NULL || threads <= 1)
+    {
+        shapeWalk(root, 0, children, report);
+        return report;
+    }
+
+    // Split off subtrees; the nodes above them are counted here.
+    const size_t target = (size_t)threads * 8;
+    const int maxSplitLevels = 32;
+    std::vector<std::pair<NodePtr, int> > frontier(1, std::make_pair(root, 0));
+    for(int level = 0; level < maxSplitLevels && frontier.size() < target; ++level)
+    {
+        std::vector<std::pair<NodePtr, int> > next;
+        for(size_t i = 0; i < frontier.size(); ++i)
+        {
+            NodePtr left;
+            NodePtr right;
+            children(frontier[i].first, left, right);
+            report.add(frontier[i].second, (left != NULL) + (right != NULL));
+            if(left != NULL)
+            {
+                next.push_back(std::make_pair(left, frontier[i].second + 1));
+            }
+            if(right != NULL)
+            {
+                next.push_back(std::make_pair(right, frontier[i].second + 1));
+            }
+        }
+        frontier.swap(next);
+        if(frontier.empty())
+        {
+            return report;
+        }
+    }
+
+    // Each worker pulls subtrees off the frontier until none are left.
+    std::vector<ShapeReport> partial(threads);
+    std::atomic<size_t> nextSubtree(0);
+    std::vector<std::thread> workers;
+    for(unsigned t = 0; t < threads; ++t)
+    {
+        workers.push_back(std::thread([&, t]() {
+            size_t i;
+            while((i = nextSubtree.fetch_add(1)) < frontier.size())
+            {
+                shapeWalk(frontier[i].first, frontier[i].second, children, partial[t]);
+            }
+        }));
+    }
+    for(unsigned t = 0; t < threads; ++t)
+    {
+        workers[t].join();
+        report.merge(partial[t]);
+    }
+    return report;
+}
+
+#endif
@@ -0,0 +1,643 @@
+#ifndef SHARED_AVL_H
+#define SHARED_AVL_H
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "compact-avl.h"
+
+/**
+ * First bytes of a shared tree segment. sequence is the seqlock: the
+ * writer makes it odd before changing the tree and even again after, so
+ * a reader that saw the same even value before and after a lookup read
+ * a consistent tree. capacity is the number of node slots the writer
+ * has mapped, which tells readers when to remap.
+ */
+struct SharedTreeHeader {
+    char magic[8];        // "BSTSHM1"
+    uint32_t nodeSize;    // sizeof the node type, key and value
+    uint32_t keySize;
+    uint32_t valueSize;
+    uint32_t dataOffset;  // byte offset of slot 0
+    std::atomic<uint64_t> sequence;
+    std::atomic<uint64_t> capacity;
+    CompactTreeHeader tree;
+};
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared trees need lock-free 64-bit atomics");
+
+/**
+ * Storage policy for CompactAVLTree in a POSIX shared-memory segment
+ * (shm_open). Links are slot indices, so every process can map the
+ * segment at its own address. The writer creates or reopens the segment
+ * read-write and holds an exclusive lock on it; readers attach read-only
+ * and call refresh() to follow the segment when the writer grows it.
+ * A reader's earlier mappings stay in place until close(), so lookups
+ * still walking one are not cut off.
+ */
+template<typename NodeType>
+class SharedNodeStorage
+{
+public:
+    static const size_t DATA_OFFSET = 128;
+
+    SharedNodeStorage() : fd_(-1), base_(NULL), bytes_(0) {}
+    ~SharedNodeStorage() { close(); }
+
+    void create(const std::string& name, size_t initialSlots);
+    void attach(const std::string& name);
+    void close();
+    bool refresh();
+
+    NodeType* nodes() { return reinterpret_cast<NodeType*>(base_ + DATA_OFFSET); }
+    const NodeType* nodes() const { return reinterpret_cast<const NodeType*>(base_ + DATA_OFFSET); }
+    size_t capacity() const { return base_ != NULL ? (bytes_ - DATA_OFFSET) / sizeof(NodeType) : 0; }
+    CompactTreeHeader& header() { return shared()->tree; }
+    const CompactTreeHeader& header() const { return shared()->tree; }
+    SharedTreeHeader* shared() { return reinterpret_cast<SharedTreeHeader*>(base_); }
+    const SharedTreeHeader* shared() const { return reinterpret_cast<const SharedTreeHeader*>(base_); }
+    size_t segmentBytes() const { return bytes_; }
+
+    void grow(size_t minSlots);
+    void reset();
+
+private:
+    static_assert(sizeof(SharedTreeHeader) <= DATA_OFFSET, "header overlaps slot 0");
+
+    SharedNodeStorage(const SharedNodeStorage&);
+    SharedNodeStorage& operator=(const SharedNodeStorage&);
+
+    void map(size_t bytes, bool writable);
+    void check(const std::string& name);
+    static uint32_t keySize() { return (uint32_t)sizeof(std::declval<NodeType>().item.first); }
+    static uint32_t valueSize() { return (uint32_t)sizeof(std::declval<NodeType>().item.second); }
+
+    int fd_;
+    char* base_;
+    size_t bytes_;
+    std::vector<std::pair<char*, size_t> > retired_;  // reader mappings replaced by refresh()
+};
+
+/**
+ * Opens the segment for writing, creating it with room for initialSlots
+ * nodes if needed. Throws if another writer holds it. A segment left by
+ * an earlier writer keeps its tree, unless that writer died mid-update,
+ * in which case the tree is torn and starts over empty.
+ */
+template<typename NodeType>
+void SharedNodeStorage<NodeType>::create(const std::string& name, size_t initialSlots)
+{
+    close();
+    fd_ = shm_open(name.c_str(), O_RDWR | O_CREAT, 0644);
+    if(fd_ < 0)
+    {
+        throw std::system_error(errno, std::generic_category(), "shm_open " + name);
+    }
+    if(flock(fd_, LOCK_EX | LOCK_NB) != 0)
+    {
+        int err = errno;
+        close();
+        if(err == EWOULDBLOCK)
+        {
+            throw std::runtime_error(name + " already has a writer");
+        }
+        throw std::system_error(err, std::generic_category(), "lock " + name);
+    }
+    struct stat st;
+    if(fstat(fd_, &st) != 0)
+    {
+        int err = errno;
+        close();
+        throw std::system_error(err, std::generic_category(), "stat " + name);
+    }
+
+    if(st.st_size != 0)
+    {
+        map((size_t)st.st_size, true);
+        check(name);
+        SharedTreeHeader* h = shared();
+        uint64_t sequence = h->sequence.load(std::memory_order_relaxed);
+        if(sequence & 1)
+        {
+            h->tree = CompactTreeHeader();
+            h->sequence.store(sequence + 1, std::memory_order_release);
+        }
+        h->capacity.store(capacity(), std::memory_order_release);
+        return;
+    }
+
+    size_t bytes = DATA_OFFSET + std::max<size_t>(initialSlots, 2) * sizeof(NodeType);
+    if(ftruncate(fd_, (off_t)bytes) != 0)
+    {
+        int err = errno;
+        close();
+        throw std::system_error(err, std::generic_category(), "resize " + name);
+    }
+    map(bytes, true);
+    SharedTreeHeader* h = new(base_) SharedTreeHeader();
+    h->nodeSize = (uint32_t)sizeof(NodeType);
+    h->keySize = keySize();
+    h->valueSize = valueSize();
+    h->dataOffset = (uint32_t)DATA_OFFSET;
+    h->sequence.store(0, std::memory_order_relaxed);
+    h->capacity.store(capacity(), std::memory_order_relaxed);
+    h->tree = CompactTreeHeader();
+    // Readers check the magic last
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(h->magic, "BSTSHM1", 8);
+}
+
+/**
+ * Maps an existing segment read-only.
+ */
+template<typename NodeType>
+void SharedNodeStorage<NodeType>::attach(const std::string& name)
+{
+    close();
+    fd_ = shm_open(name.c_str(), O_RDONLY, 0);
+    if(fd_ < 0)
+    {
+        throw std::system_error(errno, std::generic_category(), "shm_open " + name);
+    }
+    struct stat st;
+    if(fstat(fd_, &st) != 0)
+    {
+        int err = errno;
+        close();
+        throw std::system_error(err, std::generic_category(), "stat " + name);
+    }
+    if((size_t)st.st_size < DATA_OFFSET + sizeof(NodeType))
+    {
+        close();
+        throw std::runtime_error(name + " is not a shared tree");
+    }
+    map((size_t)st.st_size, false);
+    check(name);
+    std::atomic_thread_fence(std::memory_order_acquire);
+}
+
+/**
+ * Unmaps the segment (which stays in place for other processes).
+ */
+template<typename NodeType>
+void SharedNodeStorage<NodeType>::close()
+{
+    for(size_t i = 0; i < retired_.size(); ++i)
+    {
+        munmap(retired_[i].first, retired_[i].second);
+    }
+    retired_.clear();
+    if(base_ != NULL)
+    {
+        munmap(base_, bytes_);
+        base_ = NULL;
+        bytes_ = 0;
+    }
+    if(fd_ >= 0)
+    {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+/**
+ * Reader side: maps the segment again if the writer has grown it since.
+ * Returns whether the mapping changed. The old mapping is kept until
+ * close(); the segment grows by doubling, so all of them together take
+ * less address space than the current one.
+ */
+template<typename NodeType>
+bool SharedNodeStorage<NodeType>::refresh()
+{
+    if(shared()->capacity.load(std::memory_order_acquire) <= capacity())
+    {
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd_, &st) != 0)
+    {
+        throw std::system_error(errno, std::generic_category(), "stat shared tree");
+    }
+    char* old = base_;
+    size_t oldBytes = bytes_;
+    base_ = NULL;
+    try
+    {
+        map((size_t)st.st_size, false);
+    }
+    catch(...)
+    {
+        // map() closed the storage, which would have skipped this one
+        munmap(old, oldBytes);
+        throw;
+    }
+    retired_.push_back(std::make_pair(old, oldBytes));
+    return true;
+}
+
+/**
+ * Writer side: extends the segment to at least minSlots nodes (at least
+ * doubling it) and maps it again. Readers keep their smaller mapping
+ * until they see the new capacity.
+ */
+template<typename NodeType>
+void SharedNodeStorage<NodeType>::grow(size_t minSlots)
+{
+    size_t slots = std::max(minSlots, capacity() * 2);
+    size_t bytes = DATA_OFFSET + slots * sizeof(NodeType);
+    if(ftruncate(fd_, (off_t)bytes) != 0)
+    {
+        throw std::system_error(errno, std::generic_category(), "resize shared tree");
+    }
+    munmap(base_, bytes_);
+    base_ = NULL;
+    map(bytes, true);
+    shared()->capacity.store(capacity(), std::memory_order_release);
+}
+
+template<typename NodeType>
+void SharedNodeStorage<NodeType>::reset()
+{
+    header() = CompactTreeHeader();
+}
+
+template<typename NodeType>
+void SharedNodeStorage<NodeType>::map(size_t bytes, bool writable)
+{
+    void* base = mmap(NULL, bytes, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd_, 0);
+    if(base == MAP_FAILED)
+    {
+        int err = errno;
+        close();
+        throw std::system_error(err, std::generic_category(), "mmap shared tree");
+    }
+    base_ = static_cast<char*>(base);
+    bytes_ = bytes;
+}
+
+template<typename NodeType>
+void SharedNodeStorage<NodeType>::check(const std::string& name)
+{
+    const SharedTreeHeader* h = shared();
+    if(std::memcmp(h->magic, "BSTSHM1", 8) != 0 || h->dataOffset != DATA_OFFSET)
+    {
+        close();
+        throw std::runtime_error(name + " is not a shared tree");
+    }
+    if(h->nodeSize != sizeof(NodeType) || h->keySize != keySize() || h->valueSize != valueSize())
+    {
+        close();
+        throw std::runtime_error(name + " holds a different key or value type");
+    }
+}
+
+/**
+ * The writer of a tree shared by many processes: a CompactAVLTree in a
+ * shared-memory segment whose inserts and removes are published under
+ * the segment's seqlock, so SharedAVLReader lookups in other processes
+ * never act on a half-done update. There is one writer per segment.
+ *
+ * Keys and values are stored as raw bytes: they must be trivially
+ * copyable and hold no pointers. Values must not be changed through
+ * iterators, which would bypass the seqlock; insert the key again.
+ */
+template<typename Key, typename Value>
+class SharedAVLTree : private CompactAVLTree<Key, Value, SharedNodeStorage<CompactNode<Key, Value> > >
+{
+    typedef CompactAVLTree<Key, Value, SharedNodeStorage<CompactNode<Key, Value> > > Base;
+
+public:
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+                  "SharedAVLTree stores keys and values as raw bytes");
+
+    typedef typename Base::iterator iterator;
+
+    explicit SharedAVLTree(const std::string& name, size_t initialNodes = 1024)
+    {
+        this->storage_.create(name, initialNodes + 1);
+    }
+
+    void insert(const std::pair<const Key, Value>& item);
+    void remove(const Key& key);
+    void clear();
+    uint64_t version() const { return this->storage_.shared()->sequence.load(std::memory_order_relaxed) / 2; }
+    size_t segmentBytes() const { return this->storage_.segmentBytes(); }
+    static void unlink(const std::string& name) { shm_unlink(name.c_str()); }
+
+    using Base::find;
+    using Base::begin;
+    using Base::end;
+    using Base::empty;
+    using Base::size;
+    using Base::height;
+    using Base::isBalanced;
+    using Base::memoryReport;
+
+private:
+    void beginWrite();
+    void endWrite();
+};
+
+/*
+ * Marks the tree as changing: the odd sequence makes readers wait, and
+ * the fence keeps the tree writes after it.
+ */
+template<typename Key, typename Value>
+void SharedAVLTree<Key, Value>::beginWrite()
+{
+    std::atomic<uint64_t>& sequence = this->storage_.shared()->sequence;
+    sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+/*
+ * Publishes the change. Re-reads the header, since growing remaps it.
+ */
+template<typename Key, typename Value>
+void SharedAVLTree<Key, Value>::endWrite()
+{
+    std::atomic<uint64_t>& sequence = this->storage_.shared()->sequence;
+    sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+template<typename Key, typename Value>
+void SharedAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& item)
+{
+    beginWrite();
+    try
+    {
+        Base::insert(item);
+    }
+    catch(...)
+    {
+        endWrite();
+        throw;
+    }
+    endWrite();
+}
+
+template<typename Key, typename Value>
+void SharedAVLTree<Key, Value>::remove(const Key& key)
+{
+    beginWrite();
+    Base::remove(key);
+    endWrite();
+}
+
+template<typename Key, typename Value>
+void SharedAVLTree<Key, Value>::clear()
+{
+    beginWrite();
+    Base::clear();
+    endWrite();
+}
+
+/**
+ * A reader of a SharedAVLTree, typically in another process. Lookups
+ * copy the value out and are checked against the seqlock: a lookup that
+ * overlapped an update is retried, and one that runs while the writer is
+ * mid-update waits for it. Readers never write to the segment, so any
+ * number of them can look up at once.
+ *
+ * A lookup racing an update may follow links that are being rewritten;
+ * every slot is bounds-checked and the descent is capped at MAX_DEPTH,
+ * so such a lookup only ever ends up retried. If the writer dies
+ * mid-update, lookups wait until a new writer reopens the segment.
+ *
+ * One reader can be shared by threads. Each lookup works on a snapshot
+ * of the current mapping; when the writer grows the segment, the first
+ * thread to notice maps it again under a mutex and publishes a new
+ * snapshot, while the old mapping stays valid for lookups still using
+ * it until the reader is destroyed.
+ */
+template<typename Key, typename Value>
+class SharedAVLReader
+{
+public:
+    typedef CompactNode<Key, Value> NodeType;
+
+    explicit SharedAVLReader(const std::string& name);
+
+    bool find(const Key& key, Value& value) const;
+    bool contains(const Key& key) const;
+    size_t size() const;
+    uint64_t version() const;
+
+private:
+    static const int MAX_DEPTH = 64;   // AVL height for 2^31 nodes is below 46
+    static const uint32_t INDEX = 0x7fffffffu;
+
+    // One mapping of the segment, never changed once published
+    struct View {
+        const SharedTreeHeader* shared;
+        const NodeType* nodes;
+        size_t capacity;
+    };
+
+    const View* beginRead(uint64_t& sequence) const;
+    bool endRead(const View* view, uint64_t sequence) const;
+    bool lookup(const View* view, const Key& key, Value* value, bool& found) const;
+    const View* remap() const;
+    void publish() const;
+
+    mutable std::mutex remapMutex_;                   // guards storage_ and views_
+    mutable SharedNodeStorage<NodeType> storage_;
+    mutable std::vector<std::unique_ptr<View> > views_;
+    mutable std::atomic<const View*> view_;
+};
+
+template<typename Key, typename Value>
+SharedAVLReader<Key, Value>::SharedAVLReader(const std::string& name) : view_(NULL)
+{
+    storage_.attach(name);
+    publish();
+}
+
+/*
+ * Makes the storage's current mapping the one new lookups use. Called
+ * with remapMutex_ held (or before the reader is shared).
+ */
+template<typename Key, typename Value>
+void SharedAVLReader<Key, Value>::publish() const
+{
+    const SharedNodeStorage<NodeType>& storage = storage_;
+    View* view = new View;
+    view->shared = storage.shared();
+    view->nodes = storage.nodes();
+    view->capacity = storage.capacity();
+    views_.push_back(std::unique_ptr<View>(view));
+    view_.store(view, std::memory_order_release);
+}
+
+/*
+ * Follows the writer's growth, once for all threads that noticed it.
+ */
+template<typename Key, typename Value>
+const typename SharedAVLReader<Key, Value>::View* SharedAVLReader<Key, Value>::remap() const
+{
+    std::lock_guard<std::mutex> lock(remapMutex_);
+    if(storage_.refresh())
+    {
+        publish();
+    }
+    return view_.load(std::memory_order_relaxed);
+}
+
+/*
+ * Waits out an update in progress, stores the even sequence and returns
+ * a mapping that covers every slot the writer has.
+ */
+template<typename Key, typename Value>
+const typename SharedAVLReader<Key, Value>::View* SharedAVLReader<Key, Value>::beginRead(uint64_t& sequence) const
+{
+    const View* view = view_.load(std::memory_order_acquire);
+    while(true)
+    {
+        sequence = view->shared->sequence.load(std::memory_order_acquire);
+        if((sequence & 1) == 0)
+        {
+            if(view->shared->capacity.load(std::memory_order_acquire) <= view->capacity)
+            {
+                return view;
+            }
+            view = remap();
+            continue;
+        }
+        std::this_thread::yield();
+    }
+}
+
+/*
+ * Whether nothing changed since beginRead() returned sequence.
+ */
+template<typename Key, typename Value>
+bool SharedAVLReader<Key, Value>::endRead(const View* view, uint64_t sequence) const
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return view->shared->sequence.load(std::memory_order_relaxed) == sequence;
+}
+
+/*
+ * One descent. Returns false when it ran into a link it cannot trust,
+ * which only happens while the tree is changing.
+ */
+template<typename Key, typename Value>
+bool SharedAVLReader<Key, Value>::lookup(const View* view, const Key& key, Value* value, bool& found) const
+{
+    const NodeType* nodes = view->nodes;
+    size_t capacity = view->capacity;
+    uint32_t n = view->shared->tree.root;
+    found = false;
+    for(int depth = 0; n != 0; ++depth)
+    {
+        if(n >= capacity || depth > MAX_DEPTH)
+        {
+            return false;
+        }
+        BST_STAT(STAT_COMPARISONS, 1);
+        Key nodeKey = nodes[n].item.first;
+        if(key < nodeKey)
+        {
+            n = nodes[n].left & INDEX;
+        }
+        else if(nodeKey < key)
+        {
+            n = nodes[n].right & INDEX;
+        }
+        else
+        {
+            if(value != NULL)
+            {
+                *value = nodes[n].item.second;
+            }
+            found = true;
+            return true;
+        }
+    }
+    return true;
+}
+
+/**
+ * Copies key's value into value and returns true, or returns false if
+ * the key is absent.
+ */
+template<typename Key, typename Value>
+bool SharedAVLReader<Key, Value>::find(const Key& key, Value& value) const
+{
+    BST_STAT(STAT_FINDS, 1);
+    while(true)
+    {
+        uint64_t sequence;
+        const View* view = beginRead(sequence);
+        Value copy;
+        bool found;
+        bool complete = lookup(view, key, &copy, found);
+        if(endRead(view, sequence) && complete)
+        {
+            if(found)
+            {
+                value = copy;
+            }
+            return found;
+        }
+    }
+}
+
+template<typename Key, typename Value>
+bool SharedAVLReader<Key, Value>::contains(const Key& key) const
+{
+    BST_STAT(STAT_FINDS, 1);
+    while(true)
+    {
+        uint64_t sequence;
+        const View* view = beginRead(sequence);
+        bool found;
+        bool complete = lookup(view, key, NULL, found);
+        if(endRead(view, sequence) && complete)
+        {
+            return found;
+        }
+    }
+}
+
+template<typename Key, typename Value>
+size_t SharedAVLReader<Key, Value>::size() const
+{
+    while(true)
+    {
+        uint64_t sequence;
+        const View* view = beginRead(sequence);
+        size_t count = (size_t)view->shared->tree.count;
+        if(endRead(view, sequence))
+        {
+            return count;
+        }
+    }
+}
+
+/**
+ * Number of updates the writer has published so far.
+ */
+template<typename Key, typename Value>
+uint64_t SharedAVLReader<Key, Value>::version() const
+{
+    return view_.load(std::memory_order_acquire)->shared->sequence.load(std::memory_order_acquire) / 2;
+}
+
+#endif
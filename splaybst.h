@@ -0,0 +1,176 @@
+#ifndef SPLAYBST_H
+#define SPLAYBST_H
+
+#include "bst.h"
+#include <iostream>
+
+/**
+ * A splay tree: every access rotates the accessed node toward the root,
+ * so frequently used keys end up near the top and skewed lookups get
+ * cheaper than a balanced tree's full log-depth descent. Nodes are plain
+ * Nodes with no balance metadata.
+ *
+ * Two knobs limit how much a read restructures the tree:
+ *   setSplayPeriod(k)  find() only splays on every k-th successful lookup
+ *   setSemiSplay(true) zig-zig steps rotate once and continue from the
+ *                      parent, moving the node about halfway up
+ *
+ * find() and operator[] splay through the accessed() hook, so lookups
+ * through a BinarySearchTree reference splay too. Lookups on a const
+ * tree (or const reference) do not splay.
+ */
+template<class Key, class Value>
+class SplayTree : public BinarySearchTree<Key, Value> {
+public:
+    SplayTree();
+    virtual void remove(const Key& key);
+
+    void setSplayPeriod(unsigned period);
+    void setSemiSplay(bool semi);
+protected:
+    virtual Node<Key, Value>* insertAt(const NodeSearch<Key, Value>& found,
+                                       const std::pair<const Key, Value>& new_item) override;
+    virtual void accessed(Node<Key, Value>* node) override;
+
+    // Helper functions
+    void splay(Node<Key, Value>* x);
+    void rotateUp(Node<Key, Value>* x);
+
+    unsigned splayPeriod_;
+    unsigned accessCount_;
+    bool semiSplay_;
+};
+
+/**
+ * Splays on every access by default.
+ */
+template<class Key, class Value>
+SplayTree<Key, Value>::SplayTree() : splayPeriod_(1), accessCount_(0), semiSplay_(false) {}
+
+/**
+ * Splay on every k-th successful lookup (0 or 1: every time).
+ */
+template<class Key, class Value>
+void SplayTree<Key, Value>::setSplayPeriod(unsigned period) {
+    splayPeriod_ = period == 0 ? 1 : period;
+    accessCount_ = 0;
+}
+
+/**
+ * Switch between full splaying and semi-splaying.
+ */
+template<class Key, class Value>
+void SplayTree<Key, Value>::setSemiSplay(bool semi) {
+    semiSplay_ = semi;
+}
+
+/*
+ * Inserts like a plain BST and splays the new (or updated) node.
+ */
+template<class Key, class Value>
+Node<Key, Value>* SplayTree<Key, Value>::insertAt(const NodeSearch<Key, Value>& found,
+                                                  const std::pair<const Key, Value>& new_item) {
+    if (found.node != nullptr) {
+        // update value if already in tree
+        found.node->setValue(new_item.second);
+        splay(found.node);
+        return found.node;
+    }
+
+    Node<Key, Value>* newNode = new Node<Key, Value>(new_item.first, new_item.second, found.parent);
+    this->noteNodeAdded(newNode);
+    if (found.parent == nullptr) {
+        this->root_ = newNode;
+    } else if (found.left) {
+        found.parent->setLeft(newNode);
+    } else {
+        found.parent->setRight(newNode);
+    }
+    splay(newNode);
+    return newNode;
+}
+
+/*
+ * Removes like a plain BST (swap with the predecessor, splice out) and
+ * splays the parent of the removed position.
+ */
+template<class Key, class Value>
+void SplayTree<Key, Value>::remove(const Key& key) {
+    BST_STAT(STAT_REMOVES, 1);
+    LatencyTimer timer(this->latency_ ? &this->latency_->local().remove : NULL);
+
+    Node<Key, Value>* current = this->internalFind(key);
+    if (current == nullptr) {
+        return;
+    }
+    if (current->getLeft() != nullptr && current->getRight() != nullptr) {
+        this->nodeSwap(current, BinarySearchTree<Key, Value>::predecessor(current));
+    }
+    Node<Key, Value>* parent = current->getParent();
+    this->spliceOut(current);
+    this->noteNodeRemoved(current);
+    delete current;
+    if (parent != nullptr) {
+        splay(parent);
+    }
+}
+
+/*
+ * Every splayPeriod_-th lookup hit splays the node found.
+ */
+template<class Key, class Value>
+void SplayTree<Key, Value>::accessed(Node<Key, Value>* node) {
+    if (++accessCount_ >= splayPeriod_) {
+        accessCount_ = 0;
+        splay(node);
+    }
+}
+
+/*
+ * Rotates x above its parent.
+ */
+template<class Key, class Value>
+void SplayTree<Key, Value>::rotateUp(Node<Key, Value>* x) {
+    BST_STAT(STAT_SINGLE_ROTATIONS, 1);
+    Node<Key, Value>* p = x->getParent();
+    if (p->getLeft() == x) {
+        this->rotateRight(p);
+    } else {
+        this->rotateLeft(p);
+    }
+}
+
+/*
+ * Moves x to the root with zig, zig-zig and zig-zag steps. In semi-splay
+ * mode a zig-zig step only rotates the parent above the grandparent and
+ * continues from the parent.
+ */
+template<class Key, class Value>
+void SplayTree<Key, Value>::splay(Node<Key, Value>* x) {
+    while (x->getParent() != nullptr) {
+        BST_STAT(STAT_REBALANCE_STEPS, 1);
+        Node<Key, Value>* p = x->getParent();
+        Node<Key, Value>* g = p->getParent();
+
+        // zig
+        if (g == nullptr) {
+            rotateUp(x);
+            break;
+        }
+
+        bool zigZig = (g->getLeft() == p) == (p->getLeft() == x);
+        if (zigZig && semiSplay_) {
+            rotateUp(p);
+            x = p;
+        } else if (zigZig) {
+            rotateUp(p);
+            rotateUp(x);
+        } else {
+            // zig zag
+            rotateUp(x);
+            rotateUp(x);
+        }
+    }
+}
+
+#endif
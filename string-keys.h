@@ -0,0 +1,142 @@
+#ifndef STRING_KEYS_H
+#define STRING_KEYS_H
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "key-search.h"
+
+/**
+ * A string key whose bytes live elsewhere, normally in a StringKeyArena.
+ * It is a pointer and a 32-bit length, 16 bytes in a node where a
+ * std::string takes 32 plus its own heap block once the key outgrows
+ * the small-string buffer (about 15 bytes). Compares like std::string,
+ * and tree descents skip matched prefixes as they do for std::string.
+ *
+ * ArenaKey(str) makes a non-owning view, which is what lookups
+ * (find, remove, operator[]) need; keys that get inserted should come
+ * from StringKeyArena::store() so they outlive the caller's string.
+ */
+class ArenaKey
+{
+public:
+    ArenaKey() : data_(""), size_(0) {}
+    ArenaKey(const char* data, size_t size) : data_(data), size_((uint32_t)size) {}
+    explicit ArenaKey(const std::string& view) : data_(view.data()), size_((uint32_t)view.size()) {}
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    std::string str() const { return std::string(data_, size_); }
+
+    int compare(const ArenaKey& other) const
+    {
+        size_t lcp;
+        return prefixCompare(data_, size_, other.data_, other.size_, 0, lcp);
+    }
+
+private:
+    const char* data_;
+    uint32_t size_;
+};
+
+inline bool operator<(const ArenaKey& a, const ArenaKey& b) { return a.compare(b) < 0; }
+inline bool operator>(const ArenaKey& a, const ArenaKey& b) { return a.compare(b) > 0; }
+inline bool operator==(const ArenaKey& a, const ArenaKey& b) { return a.compare(b) == 0; }
+inline bool operator!=(const ArenaKey& a, const ArenaKey& b) { return a.compare(b) != 0; }
+
+inline std::ostream& operator<<(std::ostream& out, const ArenaKey& key)
+{
+    return out.write(key.data(), key.size());
+}
+
+template<>
+class KeySearch<ArenaKey> : public PrefixKeySearch<ArenaKey>
+{
+public:
+    explicit KeySearch(const ArenaKey& key) : PrefixKeySearch<ArenaKey>(key) {}
+};
+
+/**
+ * Append-only storage for key bytes, carved out of large chunks so that
+ * each key costs its length and nothing more (no per-key malloc header
+ * or rounding). Keys stay valid until the arena is destroyed; removing
+ * a key from a tree does not give its bytes back, so an arena suits
+ * bulk-loaded or append-mostly trees. The arena must outlive every tree
+ * holding its keys.
+ */
+class StringKeyArena
+{
+public:
+    explicit StringKeyArena(size_t chunkBytes = 1 << 16)
+        : chunkBytes_(chunkBytes), used_(0), free_(0), next_(NULL), stored_(0)
+    {
+    }
+
+    ~StringKeyArena()
+    {
+        for(size_t i = 0; i < chunks_.size(); ++i)
+        {
+            delete[] chunks_[i];
+        }
+    }
+
+    // Copies key into the arena.
+    ArenaKey store(const std::string& key)
+    {
+        return store(key.data(), key.size());
+    }
+
+    ArenaKey store(const char* data, size_t size)
+    {
+        if(size > UINT32_MAX)
+        {
+            throw std::length_error("ArenaKey is limited to 4 GiB");
+        }
+        if(size > free_)
+        {
+            // Oversized keys get a chunk of their own
+            size_t bytes = size > chunkBytes_ ? size : chunkBytes_;
+            chunks_.push_back(new char[bytes]);
+            next_ = chunks_.back();
+            free_ = bytes;
+            reserved_.push_back(bytes);
+        }
+        std::memcpy(next_, data, size);
+        ArenaKey key(next_, size);
+        next_ += size;
+        free_ -= size;
+        used_ += size;
+        ++stored_;
+        return key;
+    }
+
+    size_t keys() const { return stored_; }
+    size_t bytesUsed() const { return used_; }
+
+    size_t bytesReserved() const
+    {
+        size_t total = 0;
+        for(size_t i = 0; i < reserved_.size(); ++i)
+        {
+            total += reserved_[i];
+        }
+        return total;
+    }
+
+private:
+    StringKeyArena(const StringKeyArena&);
+    StringKeyArena& operator=(const StringKeyArena&);
+
+    size_t chunkBytes_;
+    size_t used_;
+    size_t free_;      // bytes left in the current chunk
+    char* next_;       // next free byte in the current chunk
+    size_t stored_;
+    std::vector<char*> chunks_;
+    std::vector<size_t> reserved_;
+};
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef TREE_MEMORY_H
+#define TREE_MEMORY_H
+
+#include <cstddef>
+#include <iostream>
+#include <type_traits>
+
+/**
+ * Byte breakdown of one tree node as laid out in memory.
+ *
+ * key/value are the inline sizes of the stored types (heap memory owned
+ * by a key such as a long std::string is not included). allocator is an
+ * estimate of the malloc header and rounding for one node allocation.
+ */
+struct NodeLayout {
+    size_t key;
+    size_t value;
+    size_t pointers;
+    size_t balance;
+    size_t vtable;
+    size_t padding;
+    size_t allocator;
+
+    NodeLayout() : key(0), value(0), pointers(0), balance(0), vtable(0), padding(0), allocator(0) {}
+
+    // sizeof the node object
+    size_t objectBytes() const { return key + value + pointers + balance + vtable + padding; }
+
+    // bytes one node really costs on the heap
+    size_t totalBytes() const { return objectBytes() + allocator; }
+};
+
+/**
+ * Estimated heap chunk size for a request of n bytes, following the
+ * usual 64-bit dlmalloc/glibc rules: one size word of header, 16-byte
+ * alignment, 32-byte minimum chunk.
+ */
+inline size_t mallocChunkBytes(size_t n)
+{
+    size_t chunk = (n + sizeof(size_t) + 15) & ~(size_t)15;
+    return chunk < 32 ? 32 : chunk;
+}
+
+/**
+ * Builds the layout of a node type holding a Key/Value pair, the given
+ * number of link pointers and `balanceBytes` of per-node metadata.
+ */
+template<typename NodeType, typename Key, typename Value>
+NodeLayout describeNode(size_t linkPointers, size_t balanceBytes)
+{
+    NodeLayout layout;
+    layout.key = sizeof(Key);
+    layout.value = sizeof(Value);
+    layout.pointers = linkPointers * sizeof(void*);
+    layout.balance = balanceBytes;
+    layout.vtable = std::is_polymorphic<NodeType>::value ? sizeof(void*) : 0;
+    layout.padding = sizeof(NodeType) - (layout.key + layout.value + layout.pointers + layout.balance + layout.vtable);
+    layout.allocator = mallocChunkBytes(sizeof(NodeType)) - sizeof(NodeType);
+    return layout;
+}
+
+/**
+ * Memory used by a tree: the per-node layout plus live and peak node
+ * counts, which the tree maintains on every allocation and free.
+ */
+struct MemoryReport {
+    NodeLayout node;
+    size_t liveNodes;
+    size_t peakNodes;
+
+    MemoryReport() : liveNodes(0), peakNodes(0) {}
+
+    size_t liveBytes() const { return liveNodes * node.totalBytes(); }
+    size_t peakBytes() const { return peakNodes * node.totalBytes(); }
+
+    void print(std::ostream& out) const
+    {
+        out << "node bytes:  " << node.totalBytes() << " (key " << node.key << ", value " << node.value
+            << ", pointers " << node.pointers << ", balance " << node.balance << ", vtable " << node.vtable
+            << ", padding " << node.padding << ", allocator " << node.allocator << ")\n"
+            << "live nodes:  " << liveNodes << " (" << liveBytes() << " bytes)\n"
+            << "peak nodes:  " << peakNodes << " (" << peakBytes() << " bytes)" << std::endl;
+    }
+};
+
+#endif
@@ -0,0 +1,178 @@
+#ifndef TREE_STATS_H
+#define TREE_STATS_H
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+/**
+ * Operation counters for the search trees.
+ *
+ * Counting is compiled in only when BST_STATS is defined (see the
+ * Makefile); otherwise BST_STAT() expands to nothing and the trees pay
+ * nothing. Each thread bumps its own counters with plain relaxed
+ * loads/stores, so counting never contends. treeStatsSnapshot() sums
+ * every live thread plus the threads that have already exited.
+ */
+enum TreeStat {
+    STAT_INSERTS,           // insert() calls
+    STAT_REMOVES,           // remove() calls
+    STAT_FINDS,             // find() calls
+    STAT_COMPARISONS,       // nodes whose key was compared during a descent
+    STAT_SINGLE_ROTATIONS,  // rebalancing single rotations
+    STAT_DOUBLE_ROTATIONS,  // rebalancing double rotations (counted once)
+    STAT_REBALANCE_STEPS,   // nodes visited by insert_fix/remove_fix
+    STAT_NODE_SWAPS,        // nodeSwap() calls
+    STAT_COUNT
+};
+
+/**
+ * A point-in-time copy of the counters.
+ */
+struct TreeStats {
+    uint64_t counts[STAT_COUNT];
+
+    TreeStats()
+    {
+        for(int i = 0; i < STAT_COUNT; ++i)
+        {
+            counts[i] = 0;
+        }
+    }
+
+    uint64_t operator[](TreeStat stat) const { return counts[stat]; }
+
+    TreeStats& operator+=(const TreeStats& rhs)
+    {
+        for(int i = 0; i < STAT_COUNT; ++i)
+        {
+            counts[i] += rhs.counts[i];
+        }
+        return *this;
+    }
+
+    static const char* name(TreeStat stat)
+    {
+        static const char* names[STAT_COUNT] = {
+            "inserts", "removes", "finds", "comparisons",
+            "single_rotations", "double_rotations", "rebalance_steps", "node_swaps"
+        };
+        return names[stat];
+    }
+
+    // One "name value" pair per line, for metrics exporters.
+    void print(std::ostream& out) const
+    {
+        for(int i = 0; i < STAT_COUNT; ++i)
+        {
+            out << name((TreeStat)i) << " " << counts[i] << "\n";
+        }
+        out.flush();
+    }
+};
+
+/**
+ * Per-thread counter block. Only its owning thread writes it.
+ */
+struct ThreadTreeStats {
+    std::atomic<uint64_t> counts[STAT_COUNT];
+
+    ThreadTreeStats();
+    ~ThreadTreeStats();
+
+    void add(TreeStat stat, uint64_t n)
+    {
+        counts[stat].store(counts[stat].load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    void read(TreeStats& out) const
+    {
+        for(int i = 0; i < STAT_COUNT; ++i)
+        {
+            out.counts[i] += counts[i].load(std::memory_order_relaxed);
+        }
+    }
+};
+
+/**
+ * All live counter blocks, plus the totals of exited threads.
+ */
+struct TreeStatsRegistry {
+    std::mutex mutex;
+    std::vector<ThreadTreeStats*> threads;
+    TreeStats retired;
+
+    static TreeStatsRegistry& instance()
+    {
+        static TreeStatsRegistry registry;
+        return registry;
+    }
+};
+
+inline ThreadTreeStats::ThreadTreeStats()
+{
+    for(int i = 0; i < STAT_COUNT; ++i)
+    {
+        counts[i].store(0, std::memory_order_relaxed);
+    }
+    TreeStatsRegistry& registry = TreeStatsRegistry::instance();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.threads.push_back(this);
+}
+
+inline ThreadTreeStats::~ThreadTreeStats()
+{
+    TreeStatsRegistry& registry = TreeStatsRegistry::instance();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    read(registry.retired);
+    for(size_t i = 0; i < registry.threads.size(); ++i)
+    {
+        if(registry.threads[i] == this)
+        {
+            registry.threads[i] = registry.threads.back();
+            registry.threads.pop_back();
+            break;
+        }
+    }
+}
+
+inline ThreadTreeStats& threadTreeStats()
+{
+    static thread_local ThreadTreeStats stats;
+    return stats;
+}
+
+/**
+ * Sums the counters of all threads.
+ */
+inline TreeStats treeStatsSnapshot()
+{
+    TreeStatsRegistry& registry = TreeStatsRegistry::instance();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    TreeStats total = registry.retired;
+    for(size_t i = 0; i < registry.threads.size(); ++i)
+    {
+        registry.threads[i]->read(total);
+    }
+    return total;
+}
+
+/**
+ * Counters of the calling thread only.
+ */
+inline TreeStats threadTreeStatsSnapshot()
+{
+    TreeStats stats;
+    threadTreeStats().read(stats);
+    return stats;
+}
+
+#ifdef BST_STATS
+#define BST_STAT(stat, n) threadTreeStats().add((stat), (n))
+#else
+#define BST_STAT(stat, n) ((void)0)
+#endif
+
+#endif